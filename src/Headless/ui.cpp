@@ -0,0 +1,317 @@
+//
+// Headless UI backend, ImGui draw lists are rasterized in software to a memory buffer
+//
+// No window and no GPU - used for automated screenshot tests on servers without a display.
+// Environment:
+//   EMU6502_HEADLESS_FRAMES      number of frames before ui_beginframe() reports done (default 300)
+//   EMU6502_HEADLESS_SIZE        output size, e.g. 1280x800 (default)
+//   EMU6502_HEADLESS_SCREENSHOT  PNG written with the last frame
+//
+
+#include "imgui.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../pngwriter.h"
+
+#define DEFAULT_WIDTH       1280
+#define DEFAULT_HEIGHT      800
+#define DEFAULT_NUM_FRAMES  300
+
+struct Texture {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<uint32_t> texels;   // RGBA, R in the lowest byte (same as IM_COL32)
+};
+
+// Texture id 'n' is handed to ImGui as n + 1, zero is no texture
+static std::vector<Texture> textures;
+static Texture framebuffer;
+static int idFontTexture = -1;
+static int nFrames = 0;
+static int maxFrames = DEFAULT_NUM_FRAMES;
+static std::string screenshotRequest;
+static std::string screenshotAtClose;
+static const uint32_t clearColor = 0xff998c73;      // same as the Win32 backend (0.45, 0.55, 0.60)
+
+static inline ImTextureID ToTextureID(int idTexture) {
+    return reinterpret_cast<ImTextureID>(static_cast<intptr_t>(idTexture + 1));
+}
+
+static inline const Texture *FromTextureID(ImTextureID id) {
+    auto idx = static_cast<intptr_t>(reinterpret_cast<intptr_t>(id)) - 1;
+    if ((idx < 0) || (idx >= static_cast<intptr_t>(textures.size()))) {
+        return nullptr;
+    }
+    return &textures[idx];
+}
+
+//
+// Texture interface, same as the other backends
+//
+int ui_createtexture(size_t width, size_t height) {
+    Texture texture;
+    texture.width = width;
+    texture.height = height;
+    texture.texels.assign(width * height, 0xff4080ff);
+    textures.push_back(std::move(texture));
+    return static_cast<int>(textures.size() - 1);
+}
+
+void *ui_gettexturehandle(int idTexture) {
+    return reinterpret_cast<void *>(ToTextureID(idTexture));
+}
+
+void *ui_locktexture(int idTexture) {
+    return textures[idTexture].texels.data();
+}
+
+void ui_unlocktexture(int idTexture) {
+}
+
+void ui_updatetexturerows(int idTexture, const void *ptrData, const size_t width, const size_t height, const size_t firstRow, const size_t nRows) {
+    auto &texture = textures[idTexture];
+    if ((texture.width != width) || (texture.height != height)) return;
+    if (firstRow + nRows > height) return;
+    memcpy(&texture.texels[firstRow * width], static_cast<const uint32_t *>(ptrData) + firstRow * width, nRows * width * sizeof(uint32_t));
+}
+
+void ui_updatetexture(int idTexture, const void *ptrData, const size_t width, const size_t height) {
+    ui_updatetexturerows(idTexture, ptrData, width, height, 0, height);
+}
+
+//
+// Software rasterizer
+//
+struct ClipRect {
+    int32_t x0, y0, x1, y1;     // [x0, x1) x [y0, y1)
+};
+
+static inline float EdgeFunction(const ImVec2 &a, const ImVec2 &b, float px, float py) {
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// Pixels exactly on an edge belongs to only one of the triangles sharing it, otherwise the shared diagonal of
+// translucent quads would be blended twice
+static inline bool IsOwnedEdge(const ImVec2 &a, const ImVec2 &b) {
+    auto dx = b.x - a.x;
+    auto dy = b.y - a.y;
+    return (dy > 0) || ((dy == 0) && (dx > 0));
+}
+
+static inline uint32_t SampleTexture(const Texture *texture, float u, float v) {
+    if (texture == nullptr) {
+        return 0xffffffff;
+    }
+    auto x = std::clamp<int32_t>(static_cast<int32_t>(u * texture->width), 0, int32_t(texture->width) - 1);
+    auto y = std::clamp<int32_t>(static_cast<int32_t>(v * texture->height), 0, int32_t(texture->height) - 1);
+    return texture->texels[y * texture->width + x];
+}
+
+// Straight alpha 'src' over opaque 'dst'
+static inline uint32_t BlendOver(uint32_t dst, float r, float g, float b, float a) {
+    auto blend = [a](uint32_t d, float s) {
+        return static_cast<uint32_t>(s * a + float(d) * (1.0f - a) + 0.5f);
+    };
+    auto dr = blend(dst & 0xff, r);
+    auto dg = blend((dst >> 8) & 0xff, g);
+    auto db = blend((dst >> 16) & 0xff, b);
+    return dr | (dg << 8) | (db << 16) | 0xff000000;
+}
+
+static inline float Channel(ImU32 col, int shift) {
+    return float((col >> shift) & 0xff);
+}
+
+static void RasterizeTriangle(const ImDrawVert &vtx0, const ImDrawVert &vtx1, const ImDrawVert &vtx2, const Texture *texture, const ClipRect &clip) {
+    const ImDrawVert *v[3] = { &vtx0, &vtx1, &vtx2 };
+    auto area = EdgeFunction(v[0]->pos, v[1]->pos, v[2]->pos.x, v[2]->pos.y);
+    if (area == 0.0f) {
+        return;
+    }
+    // ImGui doesn't guarantee the winding
+    if (area < 0.0f) {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    auto &p0 = v[0]->pos;
+    auto &p1 = v[1]->pos;
+    auto &p2 = v[2]->pos;
+
+    auto x0 = std::max<int32_t>(clip.x0, static_cast<int32_t>(std::floor(std::min({p0.x, p1.x, p2.x}))));
+    auto y0 = std::max<int32_t>(clip.y0, static_cast<int32_t>(std::floor(std::min({p0.y, p1.y, p2.y}))));
+    auto x1 = std::min<int32_t>(clip.x1, static_cast<int32_t>(std::ceil(std::max({p0.x, p1.x, p2.x}))));
+    auto y1 = std::min<int32_t>(clip.y1, static_cast<int32_t>(std::ceil(std::max({p0.y, p1.y, p2.y}))));
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
+
+    bool owned0 = IsOwnedEdge(p1, p2);
+    bool owned1 = IsOwnedEdge(p2, p0);
+    bool owned2 = IsOwnedEdge(p0, p1);
+    auto invArea = 1.0f / area;
+    bool solidColor = (v[0]->col == v[1]->col) && (v[1]->col == v[2]->col);
+
+    for(int32_t y=y0;y<y1;y++) {
+        auto py = float(y) + 0.5f;
+        auto dst = &framebuffer.texels[y * framebuffer.width];
+        for(int32_t x=x0;x<x1;x++) {
+            auto px = float(x) + 0.5f;
+            auto w0 = EdgeFunction(p1, p2, px, py);
+            auto w1 = EdgeFunction(p2, p0, px, py);
+            auto w2 = EdgeFunction(p0, p1, px, py);
+            if ((w0 < 0) || (w1 < 0) || (w2 < 0)) continue;
+            if (((w0 == 0) && !owned0) || ((w1 == 0) && !owned1) || ((w2 == 0) && !owned2)) continue;
+            w0 *= invArea;
+            w1 *= invArea;
+            w2 *= invArea;
+
+            auto u = v[0]->uv.x * w0 + v[1]->uv.x * w1 + v[2]->uv.x * w2;
+            auto t = v[0]->uv.y * w0 + v[1]->uv.y * w1 + v[2]->uv.y * w2;
+            auto texel = SampleTexture(texture, u, t);
+
+            float col[4];
+            for(int c=0;c<4;c++) {
+                auto shift = c * 8;
+                col[c] = solidColor ? Channel(v[0]->col, shift) :
+                         Channel(v[0]->col, shift) * w0 + Channel(v[1]->col, shift) * w1 + Channel(v[2]->col, shift) * w2;
+                col[c] = col[c] * Channel(texel, shift) * (1.0f / 255.0f);
+            }
+            auto alpha = col[3] * (1.0f / 255.0f);
+            if (alpha <= 0.0f) continue;
+            dst[x] = BlendOver(dst[x], col[0], col[1], col[2], alpha);
+        }
+    }
+}
+
+static void RenderDrawData(ImDrawData *drawData) {
+    std::fill(framebuffer.texels.begin(), framebuffer.texels.end(), clearColor);
+    auto clipOffset = drawData->DisplayPos;
+    for(int n=0;n<drawData->CmdListsCount;n++) {
+        const ImDrawList *cmdList = drawData->CmdLists[n];
+        for(int idxCmd=0;idxCmd<cmdList->CmdBuffer.Size;idxCmd++) {
+            auto &cmd = cmdList->CmdBuffer[idxCmd];
+            if (cmd.UserCallback != nullptr) {
+                if (cmd.UserCallback != ImDrawCallback_ResetRenderState) {
+                    cmd.UserCallback(cmdList, &cmd);
+                }
+                continue;
+            }
+            ClipRect clip = {
+                std::max<int32_t>(0, static_cast<int32_t>(cmd.ClipRect.x - clipOffset.x)),
+                std::max<int32_t>(0, static_cast<int32_t>(cmd.ClipRect.y - clipOffset.y)),
+                std::min<int32_t>(int32_t(framebuffer.width), static_cast<int32_t>(cmd.ClipRect.z - clipOffset.x)),
+                std::min<int32_t>(int32_t(framebuffer.height), static_cast<int32_t>(cmd.ClipRect.w - clipOffset.y)),
+            };
+            if ((clip.x0 >= clip.x1) || (clip.y0 >= clip.y1)) {
+                continue;
+            }
+            auto texture = FromTextureID(cmd.TextureId);
+            auto idx = &cmdList->IdxBuffer[cmd.IdxOffset];
+            auto vtx = &cmdList->VtxBuffer[cmd.VtxOffset];
+            for(unsigned int i=0;i + 2<cmd.ElemCount;i+=3) {
+                RasterizeTriangle(vtx[idx[i]], vtx[idx[i + 1]], vtx[idx[i + 2]], texture, clip);
+            }
+        }
+    }
+}
+
+static bool WriteScreenshot(const std::string &filename) {
+    auto res = PNGWriter::WriteRGBA(filename, framebuffer.texels.data(), framebuffer.width, framebuffer.height);
+    if (!res) {
+        printf("ERR: Unable to write screenshot: %s\n", filename.c_str());
+    }
+    return res;
+}
+
+//
+// Frame interface
+//
+
+// The screenshot is taken at the end of the current frame
+void ui_requestscreenshot(const char *filename) {
+    screenshotRequest = filename;
+}
+
+// Last rendered frame, RGBA
+const void *ui_framebuffer(size_t *width, size_t *height) {
+    *width = framebuffer.width;
+    *height = framebuffer.height;
+    return framebuffer.texels.data();
+}
+
+int ui_initialize() {
+    size_t width = DEFAULT_WIDTH;
+    size_t height = DEFAULT_HEIGHT;
+    if (auto env = getenv("EMU6502_HEADLESS_SIZE")) {
+        unsigned w, h;
+        if (sscanf(env, "%ux%u", &w, &h) == 2) {
+            width = w;
+            height = h;
+        }
+    }
+    if (auto env = getenv("EMU6502_HEADLESS_FRAMES")) {
+        maxFrames = atoi(env);
+    }
+    if (auto env = getenv("EMU6502_HEADLESS_SCREENSHOT")) {
+        screenshotAtClose = env;
+    }
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.texels.assign(width * height, clearColor);
+
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(float(width), float(height));
+    io.IniFilename = nullptr;       // Same layout every run
+    ImGui::StyleColorsDark();
+    return 0;
+}
+
+bool ui_beginframe() {
+    if (nFrames >= maxFrames) {
+        return true;
+    }
+    ImGuiIO &io = ImGui::GetIO();
+    // Fonts are added after ui_initialize, the atlas is built on the first frame (as the GPU backends do)
+    if (idFontTexture < 0) {
+        unsigned char *pixels;
+        int width, height;
+        io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+        idFontTexture = ui_createtexture(width, height);
+        ui_updatetexture(idFontTexture, pixels, width, height);
+        io.Fonts->SetTexID(ToTextureID(idFontTexture));
+    }
+    // Fixed time step, the output doesn't depend on the speed of the host
+    io.DeltaTime = 1.0f / 60.0f;
+    ImGui::NewFrame();
+    return false;
+}
+
+void ui_endframe() {
+    ImGui::Render();
+    RenderDrawData(ImGui::GetDrawData());
+    nFrames++;
+    if (!screenshotRequest.empty()) {
+        WriteScreenshot(screenshotRequest);
+        screenshotRequest.clear();
+    }
+}
+
+void ui_close() {
+    if (!screenshotAtClose.empty()) {
+        WriteScreenshot(screenshotAtClose);
+    }
+    ImGui::DestroyContext();
+    textures.clear();
+    idFontTexture = -1;
+}
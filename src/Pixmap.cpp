@@ -4,6 +4,18 @@
 
 #include "Pixmap.h"
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+// SSE2 is part of x86-64, MSVC doesn't define __SSE2__ for x64
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EMU6502_PIXMAP_SSE2
+#endif
 
 const RGBA Pixmap::White = {255,255,255,255};
 const RGBA Pixmap::Black = {0,0,0,255};
@@ -15,17 +27,63 @@ const RGBA Pixmap::Blue = {0,0,255 ,255};
 Pixmap::Pixmap(void *ptr, size_t width, size_t height) :
     data(ptr),
     w(width),
-    h(height) {
+    h(height),
+    ownsData(false) {
+}
+
+Pixmap::Pixmap(size_t width, size_t height) :
+    data(new RGBA[width * height]),
+    w(width),
+    h(height),
+    ownsData(true) {
+}
+
+Pixmap::~Pixmap() {
+    if (ownsData) {
+        delete[] reinterpret_cast<RGBA *>(data);
+    }
 }
 
-Pixmap::Pixmap(size_t width, size_t height) : w(width), h(height) {
-    data = malloc(sizeof(RGBA) * w * h);
+Pixmap::Pixmap(Pixmap &&other) noexcept :
+    data(std::exchange(other.data, nullptr)),
+    w(std::exchange(other.w, 0)),
+    h(std::exchange(other.h, 0)),
+    ownsData(std::exchange(other.ownsData, false)) {
 }
 
+Pixmap &Pixmap::operator=(Pixmap &&other) noexcept {
+    if (this != &other) {
+        if (ownsData) {
+            delete[] reinterpret_cast<RGBA *>(data);
+        }
+        data = std::exchange(other.data, nullptr);
+        w = std::exchange(other.w, 0);
+        h = std::exchange(other.h, 0);
+        ownsData = std::exchange(other.ownsData, false);
+    }
+    return *this;
+}
+
+static inline uint32_t PackRGBA(RGBA col) {
+    uint32_t v;
+    memcpy(&v, &col, sizeof(v));
+    return v;
+}
 
 void Pixmap::Clear(RGBA col) {
     RGBA *pImage = reinterpret_cast<RGBA *>(data);
-    for(size_t i=0;i<w*h;i++) {
+    size_t n = w * h;
+    size_t i = 0;
+#if defined(EMU6502_PIXMAP_SSE2)
+    auto v = _mm_set1_epi32(static_cast<int>(PackRGBA(col)));
+    for(;i + 16 <= n;i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pImage[i]), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pImage[i + 4]), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pImage[i + 8]), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pImage[i + 12]), v);
+    }
+#endif
+    for(;i<n;i++) {
         pImage[i] = col;
     }
 }
@@ -47,3 +105,204 @@ RGBA Pixmap::GetPixel(uint32_t x, uint32_t y) {
     return Pixmap::Black;
 }
 
+
+void Pixmap::FromIndexed(const uint8_t *indices, size_t stride, const RGBA *palette16) {
+    FromIndexed(indices, stride, palette16, 0, h);
+}
+
+// 16 pixels at a time, with SSSE3 the palette is split in to one pshufb table per channel
+void Pixmap::FromIndexed(const uint8_t *indices, size_t stride, const RGBA *palette16, size_t firstRow, size_t nRows) {
+    RGBA *pImage = reinterpret_cast<RGBA *>(data);
+    auto lastRow = std::min(firstRow + nRows, h);
+    size_t xVector = 0;
+#if defined(__SSSE3__)
+    uint8_t channels[4][16];
+    for(int i=0;i<16;i++) {
+        channels[0][i] = palette16[i].r;
+        channels[1][i] = palette16[i].g;
+        channels[2][i] = palette16[i].b;
+        channels[3][i] = palette16[i].a;
+    }
+    auto lutR = _mm_loadu_si128(reinterpret_cast<const __m128i *>(channels[0]));
+    auto lutG = _mm_loadu_si128(reinterpret_cast<const __m128i *>(channels[1]));
+    auto lutB = _mm_loadu_si128(reinterpret_cast<const __m128i *>(channels[2]));
+    auto lutA = _mm_loadu_si128(reinterpret_cast<const __m128i *>(channels[3]));
+    auto lowNibble = _mm_set1_epi8(0x0f);
+    xVector = w & ~size_t(15);
+    for(size_t y=firstRow;y<lastRow;y++) {
+        auto src = &indices[y * stride];
+        auto dst = reinterpret_cast<__m128i *>(&pImage[y * w]);
+        for(size_t x=0;x<xVector;x+=16) {
+            auto idx = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&src[x])), lowNibble);
+            auto r = _mm_shuffle_epi8(lutR, idx);
+            auto g = _mm_shuffle_epi8(lutG, idx);
+            auto b = _mm_shuffle_epi8(lutB, idx);
+            auto a = _mm_shuffle_epi8(lutA, idx);
+            auto rgLo = _mm_unpacklo_epi8(r, g);
+            auto rgHi = _mm_unpackhi_epi8(r, g);
+            auto baLo = _mm_unpacklo_epi8(b, a);
+            auto baHi = _mm_unpackhi_epi8(b, a);
+            _mm_storeu_si128(dst++, _mm_unpacklo_epi16(rgLo, baLo));
+            _mm_storeu_si128(dst++, _mm_unpackhi_epi16(rgLo, baLo));
+            _mm_storeu_si128(dst++, _mm_unpacklo_epi16(rgHi, baHi));
+            _mm_storeu_si128(dst++, _mm_unpackhi_epi16(rgHi, baHi));
+        }
+    }
+#elif defined(EMU6502_PIXMAP_SSE2)
+    // No pshufb, a table with every pair of colors (2kb) instead, each 16 bit word of the indices is one pair
+    uint64_t pairs[256];
+    for(int i=0;i<256;i++) {
+        pairs[i] = PackRGBA(palette16[i & 0x0f]) | (uint64_t(PackRGBA(palette16[i >> 4])) << 32);
+    }
+    auto lowNibble = _mm_set1_epi8(0x0f);
+    auto lowByte = _mm_set1_epi16(0xff);
+    xVector = w & ~size_t(15);
+    for(size_t y=firstRow;y<lastRow;y++) {
+        auto src = &indices[y * stride];
+        auto dst = reinterpret_cast<__m128i *>(&pImage[y * w]);
+        for(size_t x=0;x<xVector;x+=16) {
+            auto idx = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&src[x])), lowNibble);
+            idx = _mm_and_si128(_mm_or_si128(idx, _mm_srli_epi16(idx, 4)), lowByte);
+            _mm_storeu_si128(dst++, _mm_set_epi64x(int64_t(pairs[_mm_extract_epi16(idx, 1)]), int64_t(pairs[_mm_extract_epi16(idx, 0)])));
+            _mm_storeu_si128(dst++, _mm_set_epi64x(int64_t(pairs[_mm_extract_epi16(idx, 3)]), int64_t(pairs[_mm_extract_epi16(idx, 2)])));
+            _mm_storeu_si128(dst++, _mm_set_epi64x(int64_t(pairs[_mm_extract_epi16(idx, 5)]), int64_t(pairs[_mm_extract_epi16(idx, 4)])));
+            _mm_storeu_si128(dst++, _mm_set_epi64x(int64_t(pairs[_mm_extract_epi16(idx, 7)]), int64_t(pairs[_mm_extract_epi16(idx, 6)])));
+        }
+    }
+#endif
+    // Remaining pixels (all of them without SSE2)
+    for(size_t y=firstRow;y<lastRow;y++) {
+        for(size_t x=xVector;x<w;x++) {
+            pImage[x + y * w] = palette16[indices[x + y * stride] & 0x0f];
+        }
+    }
+}
+
+void Pixmap::Blit(const Pixmap &src, int32_t dstX, int32_t dstY) {
+    Blit(src, 0, 0, static_cast<uint32_t>(src.w), static_cast<uint32_t>(src.h), dstX, dstY);
+}
+
+// Row by row memmove, which is already vectorized by the C library
+void Pixmap::Blit(const Pixmap &src, uint32_t srcX, uint32_t srcY, uint32_t width, uint32_t height, int32_t dstX, int32_t dstY) {
+    // Clip to the source
+    int64_t x0 = srcX, y0 = srcY;
+    int64_t x1 = std::min<int64_t>(int64_t(srcX) + width, src.w);
+    int64_t y1 = std::min<int64_t>(int64_t(srcY) + height, src.h);
+    // Clip to the destination
+    if (dstX < 0) { x0 -= dstX; dstX = 0; }
+    if (dstY < 0) { y0 -= dstY; dstY = 0; }
+    x1 = std::min<int64_t>(x1, x0 + int64_t(w) - dstX);
+    y1 = std::min<int64_t>(y1, y0 + int64_t(h) - dstY);
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
+    auto nBytes = (x1 - x0) * sizeof(RGBA);
+    for(int64_t y=y0;y<y1;y++) {
+        memmove(&Row(uint32_t(dstY + y - y0))[dstX], &src.Row(uint32_t(y))[x0], nBytes);
+    }
+}
+
+void Pixmap::ScaleNearest(const Pixmap &src, uint32_t factor) {
+    ScaleNearest(src, factor, 0, src.h);
+}
+
+void Pixmap::ScaleNearest(const Pixmap &src, uint32_t factor, size_t firstRow, size_t nRows) {
+    if (factor <= 1) {
+        Blit(src, 0, uint32_t(firstRow), uint32_t(src.w), uint32_t(nRows), 0, int32_t(firstRow));
+        return;
+    }
+    auto sw = std::min<size_t>(src.w, w / factor);
+    auto sh = std::min<size_t>({src.h, h / factor, firstRow + nRows});
+    for(size_t y=firstRow;y<sh;y++) {
+        auto srcRow = src.Row(uint32_t(y));
+        auto dstRow = Row(uint32_t(y * factor));
+        size_t x = 0;
+#if defined(EMU6502_PIXMAP_SSE2)
+        if (factor == 2) {
+            for(;x + 4 <= sw;x += 4) {
+                auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&srcRow[x]));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&dstRow[x * 2]), _mm_unpacklo_epi32(p, p));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&dstRow[x * 2 + 4]), _mm_unpackhi_epi32(p, p));
+            }
+        } else if (factor == 4) {
+            for(;x < sw;x++) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&dstRow[x * 4]), _mm_set1_epi32(static_cast<int>(PackRGBA(srcRow[x]))));
+            }
+        }
+#endif
+        for(;x<sw;x++) {
+            for(uint32_t i=0;i<factor;i++) {
+                dstRow[x * factor + i] = srcRow[x];
+            }
+        }
+        // The other rows are copies of the first
+        for(uint32_t i=1;i<factor;i++) {
+            memcpy(Row(uint32_t(y * factor + i)), dstRow, sw * factor * sizeof(RGBA));
+        }
+    }
+}
+
+//
+// Scale2x, see: https://www.scale2x.it/algorithm
+//     A          E0 E1
+//   C P B   ->   E2 E3
+//     D
+// The neighbours are clamped at the edges of 'src'
+//
+static inline void Scale2xPixel(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t p, uint32_t *dst0, uint32_t *dst1) {
+    if ((c == a) && (c != d) && (a != b)) dst0[0] = a; else dst0[0] = p;
+    if ((a == b) && (a != c) && (b != d)) dst0[1] = b; else dst0[1] = p;
+    if ((d == c) && (d != b) && (c != a)) dst1[0] = c; else dst1[0] = p;
+    if ((b == d) && (b != a) && (d != c)) dst1[1] = d; else dst1[1] = p;
+}
+
+#if defined(EMU6502_PIXMAP_SSE2)
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+void Pixmap::Scale2x(const Pixmap &src) {
+    auto sw = std::min<size_t>(src.w, w / 2);
+    auto sh = std::min<size_t>(src.h, h / 2);
+    if ((sw == 0) || (sh == 0)) {
+        return;
+    }
+    for(size_t y=0;y<sh;y++) {
+        auto up = reinterpret_cast<const uint32_t *>(src.Row(uint32_t(y > 0 ? y - 1 : 0)));
+        auto mid = reinterpret_cast<const uint32_t *>(src.Row(uint32_t(y)));
+        auto down = reinterpret_cast<const uint32_t *>(src.Row(uint32_t(std::min(y + 1, src.h - 1))));
+        auto dst0 = reinterpret_cast<uint32_t *>(Row(uint32_t(y * 2)));
+        auto dst1 = reinterpret_cast<uint32_t *>(Row(uint32_t(y * 2 + 1)));
+
+        // First pixel has no left neighbour
+        Scale2xPixel(up[0], mid[std::min<size_t>(1, src.w - 1)], mid[0], down[0], mid[0], &dst0[0], &dst1[0]);
+        size_t x = 1;
+#if defined(EMU6502_PIXMAP_SSE2)
+        // Four pixels at a time, as long as the right neighbours are within the source row
+        for(;(x + 4 <= sw) && (x + 5 <= src.w);x += 4) {
+            auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&mid[x]));
+            auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&up[x]));
+            auto d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&down[x]));
+            auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&mid[x - 1]));
+            auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&mid[x + 1]));
+            auto ca = _mm_cmpeq_epi32(c, a);
+            auto cd = _mm_cmpeq_epi32(c, d);
+            auto ab = _mm_cmpeq_epi32(a, b);
+            auto bd = _mm_cmpeq_epi32(b, d);
+            auto e0 = Select(_mm_andnot_si128(_mm_or_si128(cd, ab), ca), a, p);
+            auto e1 = Select(_mm_andnot_si128(_mm_or_si128(ca, bd), ab), b, p);
+            auto e2 = Select(_mm_andnot_si128(_mm_or_si128(bd, ca), cd), c, p);
+            auto e3 = Select(_mm_andnot_si128(_mm_or_si128(ab, cd), bd), d, p);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst0[x * 2]), _mm_unpacklo_epi32(e0, e1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst0[x * 2 + 4]), _mm_unpackhi_epi32(e0, e1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst1[x * 2]), _mm_unpacklo_epi32(e2, e3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&dst1[x * 2 + 4]), _mm_unpackhi_epi32(e2, e3));
+        }
+#endif
+        for(;x<sw;x++) {
+            auto right = std::min<size_t>(x + 1, src.w - 1);
+            Scale2xPixel(up[x], mid[right], mid[x - 1], down[x], mid[x], &dst0[x * 2], &dst1[x * 2]);
+        }
+    }
+}
@@ -6,8 +6,9 @@
 #define EMU6502_PIXMAP_H
 
 #include <stdint.h>
+#include <stddef.h>
 
-using RGBA = struct { uint8_t r, g, b, a; };
+struct RGBA { uint8_t r, g, b, a; };
 
 class Pixmap {
 public:
@@ -18,19 +19,46 @@ public:
     static const RGBA Blue;
 
 public:
+    // Wraps 'ptr', not owned
     Pixmap(void *ptr, size_t width, size_t height);
+    // Allocates and owns the pixels
     Pixmap(size_t width, size_t height);
+    ~Pixmap();
+    Pixmap(const Pixmap &) = delete;
+    Pixmap &operator=(const Pixmap &) = delete;
+    Pixmap(Pixmap &&other) noexcept;
+    Pixmap &operator=(Pixmap &&other) noexcept;
+
     void Clear(RGBA col);
     void PutPixel(uint32_t x, uint32_t y, RGBA col);
     RGBA GetPixel(uint32_t x, uint32_t y);
+    // Converts a same sized image of palette indices, only the lower 4 bits of an index are used
+    void FromIndexed(const uint8_t *indices, size_t stride, const RGBA *palette16);
+    // Same for rows [firstRow, firstRow + nRows), 'indices' points to row 0
+    void FromIndexed(const uint8_t *indices, size_t stride, const RGBA *palette16, size_t firstRow, size_t nRows);
+
+    // Copies 'src' to (dstX, dstY), clipped to both pixmaps
+    void Blit(const Pixmap &src, int32_t dstX, int32_t dstY);
+    void Blit(const Pixmap &src, uint32_t srcX, uint32_t srcY, uint32_t width, uint32_t height, int32_t dstX, int32_t dstY);
+    // Integer upscale of 'src' in to this pixmap, copies what fits when the sizes doesn't match
+    void ScaleNearest(const Pixmap &src, uint32_t factor);
+    // Same for the source rows [firstRow, firstRow + nRows)
+    void ScaleNearest(const Pixmap &src, uint32_t factor, size_t firstRow, size_t nRows);
+    // AdvanceMAME Scale2x, edges are smoothed without blending any colors
+    void Scale2x(const Pixmap &src);
 
     size_t Width() const { return w; }
     size_t Height() const { return h; }
     const void *Data() const { return data; }
+    void *Data() { return data; }
+    // Start of scan line 'y', no bounds check
+    inline RGBA *Row(uint32_t y) { return reinterpret_cast<RGBA *>(data) + y * w; }
+    inline const RGBA *Row(uint32_t y) const { return reinterpret_cast<const RGBA *>(data) + y * w; }
 private:
     void *data;
     size_t w;
     size_t h;
+    bool ownsData;
 };
 
 
@@ -15,6 +15,7 @@
 #include <tchar.h>
 #include <cstdio>
 #include <stdint.h>
+#include <vector>
 
 // Data
 static ID3D10Device*            g_pd3dDevice = NULL;
@@ -41,6 +42,8 @@ static int nTextures = 0;
 
     static ID3D10Texture2D *textures[MAX_TEXTURES] = {nullptr};
 static ID3D10ShaderResourceView *resourceViews[MAX_TEXTURES] = {nullptr};
+// Textures are GPU only (D3D10_USAGE_DEFAULT) so parts of them can be updated, lock/unlock goes through a CPU copy
+static std::vector<uint32_t> lockBuffers[MAX_TEXTURES];
 
 static void errx(HRESULT res) {
     char *lpBuf;
@@ -60,19 +63,22 @@ void *ui_locktexture(int idTexture) {
     ID3D10Texture2D *pTexture = textures[idTexture];
     assert(pTexture != nullptr);
 
-    D3D10_MAPPED_TEXTURE2D mappedTex;
-    pTexture->Map( D3D10CalcSubresource(0, 0, 1), D3D10_MAP_WRITE_DISCARD, 0, &mappedTex );
-
-    return mappedTex.pData;
+    D3D10_TEXTURE2D_DESC desc;
+    pTexture->GetDesc(&desc);
+    lockBuffers[idTexture].resize(desc.Width * desc.Height);
+    return lockBuffers[idTexture].data();
 }
 void ui_unlocktexture(int idTexture) {
     ID3D10Texture2D *pTexture = textures[idTexture];
     assert(pTexture != nullptr);
 
-    pTexture->Unmap( D3D10CalcSubresource(0, 0, 1) );
+    D3D10_TEXTURE2D_DESC desc;
+    pTexture->GetDesc(&desc);
+    g_pd3dDevice->UpdateSubresource(pTexture, D3D10CalcSubresource(0, 0, 1), NULL, lockBuffers[idTexture].data(), desc.Width * 4, 0);
 }
 
-void ui_updatetexture(int idTexture, const void *ptrData, const size_t width, const size_t height) {
+// Uploads rows [firstRow, firstRow + nRows) only, 'ptrData' is the full image (width x height)
+void ui_updatetexturerows(int idTexture, const void *ptrData, const size_t width, const size_t height, const size_t firstRow, const size_t nRows) {
     ID3D10Texture2D *pTexture = textures[idTexture];
     assert(pTexture != nullptr);
 
@@ -80,18 +86,15 @@ void ui_updatetexture(int idTexture, const void *ptrData, const size_t width, co
     pTexture->GetDesc(&desc);
     if (desc.Width != width) return;
     if (desc.Height != height) return;
+    if ((nRows == 0) || (firstRow + nRows > height)) return;
 
-    D3D10_MAPPED_TEXTURE2D mappedTex;
-    pTexture->Map( D3D10CalcSubresource(0, 0, 1), D3D10_MAP_WRITE_DISCARD, 0, &mappedTex );
-
-    uint8_t *pDest = reinterpret_cast<uint8_t *>(mappedTex.pData);
-    const uint8_t *pSrc = reinterpret_cast<const uint8_t *>(ptrData);
-
-    for(size_t i = 0; i<height;i++) {
-        memcpy(&pDest[i * mappedTex.RowPitch], &pSrc[4 * i * width], sizeof(uint32_t) * width);
-    }
+    D3D10_BOX box = { 0, (UINT)firstRow, 0, (UINT)width, (UINT)(firstRow + nRows), 1 };
+    const uint8_t *pSrc = reinterpret_cast<const uint8_t *>(ptrData) + firstRow * width * 4;
+    g_pd3dDevice->UpdateSubresource(pTexture, D3D10CalcSubresource(0, 0, 1), &box, pSrc, (UINT)(width * 4), 0);
+}
 
-    pTexture->Unmap( D3D10CalcSubresource(0, 0, 1) );
+void ui_updatetexture(int idTexture, const void *ptrData, const size_t width, const size_t height) {
+    ui_updatetexturerows(idTexture, ptrData, width, height, 0, height);
 }
 
 int ui_createtexture(size_t width, size_t height) {
@@ -105,13 +108,20 @@ int ui_createtexture(size_t width, size_t height) {
     desc.MipLevels = desc.ArraySize = 1;
     desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
     desc.SampleDesc.Count = 1;
-    desc.Usage = D3D10_USAGE_DYNAMIC;
+    desc.Usage = D3D10_USAGE_DEFAULT;
     desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
-    desc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+    desc.CPUAccessFlags = 0;
+
+    // Initial content
+    std::vector<uint32_t> texels(width * height, 0xff4080ff);     // ABGR
+    D3D10_SUBRESOURCE_DATA initialData;
+    ZeroMemory(&initialData, sizeof(initialData));
+    initialData.pSysMem = texels.data();
+    initialData.SysMemPitch = (UINT)(width * 4);
 
     ID3D10Texture2D *pTexture;
 
-    auto res = g_pd3dDevice->CreateTexture2D( &desc, NULL, &pTexture );
+    auto res = g_pd3dDevice->CreateTexture2D( &desc, &initialData, &pTexture );
     if (FAILED(res)) {
         errx(res);
     }
@@ -130,27 +140,7 @@ int ui_createtexture(size_t width, size_t height) {
     //pTexture->Release();
     resourceViews[nTextures] = pTextureView;
 
-
-    D3D10_MAPPED_TEXTURE2D mappedTex;
-    pTexture->Map( D3D10CalcSubresource(0, 0, 1), D3D10_MAP_WRITE_DISCARD, 0, &mappedTex );
-
-    UCHAR* pTexels = (UCHAR*)mappedTex.pData;
-    for( UINT row = 0; row < desc.Height; row++ )
-    {
-        UINT rowStart = row * mappedTex.RowPitch;
-        for( UINT col = 0; col < desc.Width; col++ )
-        {
-            UINT colStart = col * 4;
-            pTexels[rowStart + colStart + 0] = 255; // Red
-            pTexels[rowStart + colStart + 1] = 128; // Green
-            pTexels[rowStart + colStart + 2] = 64;  // Blue
-            pTexels[rowStart + colStart + 3] = 255;  // Alpha
-        }
-    }
-
-    pTexture->Unmap( D3D10CalcSubresource(0, 0, 1) );
-
-    return nTextures;
+    return nTextures++;
 }
 
 
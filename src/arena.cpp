@@ -0,0 +1,95 @@
+//
+// Arena for running many machines in one process
+//
+#include <cstdio>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "arena.h"
+
+template<const VICModel &model>
+MachineArena<model>::MachineArena(size_t numMachines, VICGeometry geometry /* = VICGeometry::Full */, bool useHugePages /* = true */) {
+    szArena = ArenaAlign(numMachines * szSlot, kHugePageSize);
+    if (!Allocate(useHugePages)) {
+        printf("ERR: Unable to allocate arena for %zu machines (%zu bytes)\n", numMachines, szArena);
+        return;
+    }
+    nMachines = numMachines;
+
+    for(size_t i=0;i<nMachines;i++) {
+        auto ptrSlot = SlotPtr(i);
+        new (ptrSlot + kOfsMachine) MachineType(ptrSlot + kOfsRam, ptrSlot + kOfsScreen, geometry);
+    }
+}
+
+template<const VICModel &model>
+MachineArena<model>::~MachineArena() {
+    for(size_t i=0;i<nMachines;i++) {
+        GetMachine(i).~MachineType();
+    }
+    Release();
+}
+
+#ifdef _WIN32
+template<const VICModel &model>
+bool MachineArena<model>::Allocate(bool useHugePages) {
+    // Large pages on Windows requires the 'Lock pages in memory' privilege, don't bother
+    base = reinterpret_cast<uint8_t *>(VirtualAlloc(nullptr, szArena, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    hugePageBacked = false;
+    return (base != nullptr);
+}
+
+template<const VICModel &model>
+void MachineArena<model>::Release() {
+    if (base != nullptr) {
+        VirtualFree(base, 0, MEM_RELEASE);
+    }
+    base = nullptr;
+}
+#else
+template<const VICModel &model>
+bool MachineArena<model>::Allocate(bool useHugePages) {
+    void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages, only works if the system has reserved them (vm.nr_hugepages)
+    if (useHugePages) {
+        ptr = mmap(nullptr, szArena, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        hugePageBacked = (ptr != MAP_FAILED);
+    }
+#endif
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(nullptr, szArena, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        // Fall back to transparent huge pages
+        if (useHugePages) {
+            hugePageBacked = (madvise(ptr, szArena, MADV_HUGEPAGE) == 0);
+        }
+#endif
+    }
+    base = reinterpret_cast<uint8_t *>(ptr);
+    return true;
+}
+
+template<const VICModel &model>
+void MachineArena<model>::Release() {
+    if (base != nullptr) {
+        munmap(base, szArena);
+    }
+    base = nullptr;
+}
+#endif
+
+template class MachineArena<VICModels::MOS6569>;
+template class MachineArena<VICModels::MOS6567R8>;
+template class MachineArena<VICModels::MOS6567R56A>;
+template class MachineArena<VICModels::MOS6572>;
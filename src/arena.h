@@ -0,0 +1,73 @@
+//
+// Arena for running many machines in one process
+//
+
+#ifndef EMU6502_ARENA_H
+#define EMU6502_ARENA_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "machine.h"
+
+static constexpr size_t ArenaAlign(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//
+// Places a Machine (bus, scheduler, memory, VIC and CPU including RAM and the frame buffers) per slot in one
+// contiguous allocation. The machine is packed at the start of the slot followed by RAM and the frame buffers.
+// The allocation is backed by huge pages if available (MAP_HUGETLB, falls back to transparent huge pages), this
+// keeps the TLB pressure down when running thousands of machines.
+// Running a machine never touches the heap, only the RGBA pixmaps of VIC::Screen()/PresentedScreen() are
+// allocated on first use - headless runs use the palette indices (VIC::Frame()) and never call them.
+//
+template<const VICModel &model>
+class MachineArena {
+public:
+    using MachineType = Machine<model>;
+public:
+    MachineArena(size_t numMachines, VICGeometry geometry = VICGeometry::Full, bool useHugePages = true);
+    ~MachineArena();
+    MachineArena(const MachineArena &) = delete;
+    MachineArena &operator=(const MachineArena &) = delete;
+
+    size_t NumMachines() const { return nMachines; }
+    bool IsHugePageBacked() const { return hugePageBacked; }
+    size_t SlotSize() const { return szSlot; }
+
+    MachineType &GetMachine(size_t idxMachine) { return *reinterpret_cast<MachineType *>(SlotPtr(idxMachine) + kOfsMachine); }
+private:
+    inline uint8_t *SlotPtr(size_t idxMachine) {
+        return &base[idxMachine * szSlot];
+    }
+
+    bool Allocate(bool useHugePages);
+    void Release();
+private:
+    static const size_t kPageSize = 4096;
+    static const size_t kCacheLineSize = 64;
+    static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    // Slot layout
+    static const size_t kOfsMachine = 0;
+    static const size_t kOfsRam = ArenaAlign(kOfsMachine + sizeof(MachineType), kPageSize);
+    static const size_t kOfsScreen = ArenaAlign(kOfsRam + Memory::BufferSize(), kCacheLineSize);
+    static const size_t kSlotSize = ArenaAlign(kOfsScreen + MachineType::VideoChip::ExternalBufferSize(), kPageSize);
+private:
+    size_t nMachines = 0;
+    size_t szSlot = kSlotSize;
+    size_t szArena = 0;
+    uint8_t *base = nullptr;
+    bool hugePageBacked = false;
+};
+
+extern template class MachineArena<VICModels::MOS6569>;
+extern template class MachineArena<VICModels::MOS6567R8>;
+extern template class MachineArena<VICModels::MOS6567R56A>;
+extern template class MachineArena<VICModels::MOS6572>;
+
+using MachineArenaPAL = MachineArena<VICModels::MOS6569>;
+using MachineArenaNTSC = MachineArena<VICModels::MOS6567R8>;
+
+#endif //EMU6502_ARENA_H
@@ -0,0 +1,55 @@
+//
+// Shared bus signals between the chips
+//
+
+#ifndef EMU6502_BUS_H
+#define EMU6502_BUS_H
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// One bit per cycle within a raster line (the NTSC VIC has 65 cycles per line)
+//
+class CycleMask {
+public:
+    static const size_t kMaxCycles = 128;
+public:
+    inline void Clear() { bits[0] = bits[1] = 0; }
+    inline bool Any() const { return (bits[0] | bits[1]) != 0; }
+    inline bool Test(uint32_t cycle) const { return (bits[cycle >> 6] >> (cycle & 63)) & 1; }
+    inline void Set(uint32_t cycle) { bits[cycle >> 6] |= (uint64_t(1) << (cycle & 63)); }
+    // Sets [first, last)
+    inline void SetRange(uint32_t first, uint32_t last) {
+        for(uint32_t i=first;i<last;i++) {
+            Set(i);
+        }
+    }
+private:
+    uint64_t bits[2] = {0, 0};
+};
+
+//
+// Bus arbitration between VIC and CPU (BA/AEC)
+//
+// BA (Bus Available) goes low 3 cycles before the VIC takes the bus (AEC low). The CPU stops on the first read
+// cycle after BA went low, writes may continue - but there are never more than 3 consecutive writes on a 6502.
+// see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt (section 3.6.3)
+//
+struct Bus {
+    // Max number of cycles the CPU keeps running after BA went low
+    static const uint8_t kBAGraceCycles = 3;
+    // IRQ is an open collector line, one bit per source pulling it low
+    static const uint8_t kIRQSourceVIC = 0x01;
+
+    inline void SetIRQ(uint8_t source, bool active) {
+        irq = active ? (irq | source) : (irq & ~source);
+    }
+
+    bool baLow = false;
+    uint8_t irq = 0;
+    // Statistics, number of cycles the CPU was halted
+    uint64_t cyclesStolen = 0;
+};
+
+#endif //EMU6502_BUS_H
@@ -16,10 +16,14 @@
 #include <cstdio>
 #include <cstdarg>
 #include <map>
+#include <algorithm>
 #include <functional>
 
 #include <type_traits>
 
+#define IRQ_VECTOR  0xfffe
+
+
 //
 // C++ version to properly cast an enum class : T to the underlying type T
 // example: enum class X : uint_8 {};
@@ -69,10 +73,16 @@ kDebugFlags operator |= (kDebugFlags &lhs, kDebugFlags rhs) {
 // ================
 
 
-CPU::CPU(Memory &mem) : memory(mem), mstatus(0),instrCycleCount(0) {
-    InitializeOpGroup00();
-    InitializeOpGroup01();
-    InitializeOpGroup10();
+CPU::CPU(Memory &mem) : memory(mem), bus(nullptr), mstatus(0),instrCycleCount(0), baLowCycles(0) {
+    // The op group tables are shared by all CPU instances, initialize them once
+    static bool opGroupsInitialized = []() {
+        InitializeOpGroup00();
+        InitializeOpGroup01();
+        InitializeOpGroup10();
+        return true;
+    }();
+    (void)opGroupsInitialized;
+    lastStepResult[0] = '\0';
 }
 void CPU::Initialize() {
 
@@ -85,24 +95,6 @@ void CPU::Initialize() {
     // mstatus.set(CpuFlag::Unused);
 
     debugFlags = kDebugFlags::None;
-
-
-    instructions[CpuOperands::JSR] = {
-            CpuOperands::JSR, 3, "JSR", [this](){
-                uint16_t ofs = Fetch16();
-                uint16_t ipReturn = ip;
-                SetStepResult("JSR $%04x", ofs);
-                ip = ofs;
-                Push16(ipReturn);
-            }
-    };
-    instructions[CpuOperands::RTS] = {
-            CpuOperands::RTS, 1, "RTS", [this](){
-                uint16_t ofs = Pop16();
-                SetStepResult("RTS  (ip will be: $%04x)", ofs);
-                ip = ofs;
-            }
-    };
 }
 
 void CPU::Reset(uint32_t ipAddr) {
@@ -123,12 +115,54 @@ void CPU::Load(uint32_t offset, const uint8_t *from, uint32_t nbytes) {
 
 // Ticks a single clock cycle
 void CPU::Tick() {
+    if ((bus != nullptr) && bus->baLow) {
+        // We don't track read/write per cycle, an instruction already started may finish within the grace period
+        // (those would be the write cycles) but the next opcode fetch is a read and must wait for the bus.
+        if ((instrCycleCount == 0) || (baLowCycles >= Bus::kBAGraceCycles)) {
+            bus->cyclesStolen++;
+            return;
+        }
+        baLowCycles++;
+    } else {
+        baLowCycles = 0;
+    }
+
     if (!instrCycleCount) {
-        Step();
+        StartInstruction();
     }
     instrCycleCount-=1;
 }
 
+// IRQ is level triggered and checked between instructions
+void CPU::StartInstruction() {
+    if ((bus != nullptr) && bus->irq && !mstatus[CpuFlag::InterruptDisable]) {
+        HandleIRQ();
+    } else {
+        Step();
+    }
+    // Unknown opcodes don't set a cycle count, count them as one cycle
+    if (!instrCycleCount) {
+        instrCycleCount = 1;
+    }
+}
+
+// See RunUntil() in cpu.h
+void CPU::Run(uint64_t &cycle, const uint64_t &endCycle) {
+    RunUntil(cycle, endCycle, []() { return false; });
+}
+
+// Push return address and status (B clear) then jump through the IRQ vector at $fffe
+void CPU::HandleIRQ() {
+    Push16(ip);
+    auto current = mstatus;
+    current.set(CpuFlag::Unused);
+    current.set(CpuFlag::BreakCmd, false);
+    Push8(current.raw());
+    mstatus.set(CpuFlag::InterruptDisable, true);
+    ip = ReadU16(IRQ_VECTOR);
+    instrCycleCount = 7;
+}
+
 bool CPU::Step() {
     return TryDecode();
 }
@@ -195,7 +229,7 @@ struct OperandGroup {
 
     std::string names[8];
     OperandAddrMode addrModes[8];
-    std::function<void(OperandAddrMode addrMode)> handlers[8];
+    CPU::OpHandler handlers[8];
 };
 
 
@@ -257,7 +291,7 @@ bool CPU::TryDecode() {
 
 
     if((debugFlags & kDebugFlags::StepDisAsm) == kDebugFlags::StepDisAsm) {
-        printf("$%04x    %s\n", ipCurrent, lastStepResult.c_str());
+        printf("$%04x    %s\n", ipCurrent, lastStepResult);
     }
     if ((debugFlags & kDebugFlags::StepCPUReg) == kDebugFlags::StepCPUReg) {
         printf("ADDR AR XR YR SP 01 NV-BDIZC\n");
@@ -274,6 +308,7 @@ bool CPU::TryDecode() {
 // More generic 6502 disassembler code
 //
 bool CPU::TryDecodeInternal() {
+    memory.AccessStats().OnExecute(ip);
     uint8_t incoming = Fetch8();
 
     //printf("%02x\n",incoming);
@@ -318,11 +353,11 @@ bool CPU::TryDecodeOddities(uint8_t incoming) {
                 break;
             case CpuOperands::CLI :
                 mstatus.set(CpuFlag::InterruptDisable, false);
-                SetStepResult("CLC");
+                SetStepResult("CLI");
                 break;
             case CpuOperands::SEI :
                 mstatus.set(CpuFlag::InterruptDisable,true);
-                SetStepResult("SEC");
+                SetStepResult("SEI");
                 break;
             case CpuOperands::TYA :
                 reg_a = reg_y;
@@ -457,60 +492,144 @@ bool CPU::TryDecodeBranches(uint8_t incoming) {
 
     return true;
 }
+// Prepare and solve addressing scheme...
+// Action is called with INDEX = resolved addressing (all types), V = if required to read
+// This is used for any (more?) operands in opGroup 00, 01, 10
+// see: https://llx.com/Neil/a2/opcodes.html
+//
+// Will also call SetStepResult with string formatted properly (address, indexing, etc..)
+//
+template<typename OpHandlerAction>
+void CPU::OperandResolveAddressAndExecute(const char *name, OperandAddrMode addrMode, OpHandlerAction Action) {
+    auto szOperand = OpAddrModeToSize(addrMode);
+    if ((szOperand == 1) && (addrMode == OperandAddrMode::Accumulator)) {
+        SetStepResult("%s a", name);
+        Action(0,0);
+    } else if (szOperand == 2) {
+        uint8_t v = Fetch8();
+        switch(addrMode) {
+            case OperandAddrMode::Immediate :
+                SetStepResult("%s #$%02x", name, v);
+                Action(0, v);
+                break;
+            case OperandAddrMode::Zeropage :
+                SetStepResult("%s $%02x", name, v);
+                Action(v,v);
+                break;
+            case OperandAddrMode::ZeropageX :
+                SetStepResult("%s $%02x,x",name, v);
+                v += reg_x;
+                Action(v,v);
+                break;
+            case OperandAddrMode::ZeroPageIndX :
+                {
+                    SetStepResult("%s $(%02x,x)", name, v);
+                    // Compute index in ZeroPage relative X
+                    v += reg_x;
+                    // Read final address as 16 bit from Zeropage, wraps $ff -> $00
+                    uint16_t finalAddr = ReadU16ZeroPage(v);
+                    // Now perform action with final address...
+                    Action(finalAddr, v);
+                }
+                break;
+            case OperandAddrMode::ZeroPageIndY :
+                {
+                    SetStepResult("%s $(%02x),y", name, v);
+                    uint16_t finalAddr = ReadU16ZeroPage(v);
+                    finalAddr += reg_y;
+                    Action(finalAddr, ReadU8(finalAddr));
+                }
+                break;
+        }
+    } else if (szOperand == 3) {
+        uint16_t v = Fetch16();
+        switch(addrMode) {
+            case OperandAddrMode::Absolute :
+                SetStepResult("%s $%04x", name, v);
+                Action(v,0);
+                break;
+            case OperandAddrMode::AbsoluteIndX :
+                SetStepResult("%s $%04x,x", name, v);
+                v += reg_x;
+                Action(v, 0);
+                break;
+            case OperandAddrMode::AbsoluteIndY :
+                SetStepResult("%s $%04x,y", name, v);
+                v += reg_y;
+                Action(v, 0);
+                break;
+        }
+
+    }
+
+}
+
 void CPU::InitializeOpGroup00() {
     //    static OperandGroup opGroup00={
     //            .names = {"---", "BIT", "JMP", "JMP", "STY", "LDY", "CPY", "CPX", },
-    opGroup00.handlers[0] = [this](OperandAddrMode addrMode) {
-        printf("Invalid op code!!!\n");
-        SetStepResult("INVALID!");
-    };
-    opGroup00.handlers[1] = [this](OperandAddrMode addrMode) {
-        OperandResolveAddressAndExecute("BIT", addrMode, [&](uint16_t index, uint8_t v) {
-            v = ReadU8(index);
-            if (!(v & reg_a)) {
-                mstatus.set(CpuFlag::Zero, true);
-            } else {
-                mstatus.set(CpuFlag::Zero, false);
-            }
+    opGroup00.handlers[0] = &CPU::OpHandler_Invalid;
+    opGroup00.handlers[1] = &CPU::OpHandler_BIT;
 
-        });
-    };
+    opGroup00.handlers[2] = &CPU::OpHandler_JMP;
 
-    opGroup00.handlers[2] = [this](OperandAddrMode addrMode) {
-        OperandResolveAddressAndExecute("JMP", addrMode, [&](uint16_t index, uint8_t v) {
-            ip = index;
-        });
-    };
+    // This is the indirect jump, note: the pointer never crosses a page - JMP ($xxff) reads $xxff and $xx00
+    opGroup00.handlers[3] = &CPU::OpHandler_JMPIndirect;
 
-    // This is the indirect jump
-    opGroup00.handlers[3] = [this](OperandAddrMode addrMode) {
-        OperandResolveAddressAndExecute("JMP", addrMode, [&](uint16_t index, uint8_t v) {
-            uint16_t jmpAddress = ReadU16(index);
-            ip = jmpAddress;
-        });
-    };
-
-    opGroup00.handlers[4] = [this](OperandAddrMode addrMode) {
-        OperandResolveAddressAndExecute("STY", addrMode, [&](uint16_t index, uint8_t v) {
-            WriteU8(index, reg_y);
-        });
-    };
+    opGroup00.handlers[4] = &CPU::OpHandler_STY;
 
-    opGroup00.handlers[5] = [this](OperandAddrMode addrMode) {
-        OperandResolveAddressAndExecute("LDY", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_y = v;
-            } else {
-                reg_y = ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_y);
-        });
-    };
+    opGroup00.handlers[5] = &CPU::OpHandler_LDY;
     // TODO: Implement CPY/CPX
 
 
 }
 
+void CPU::OpHandler_Invalid(OperandAddrMode addrMode) {
+    printf("Invalid op code!!!\n");
+    SetStepResult("INVALID!");
+}
+
+void CPU::OpHandler_BIT(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("BIT", addrMode, [&](uint16_t index, uint8_t v) {
+        v = ReadU8(index);
+        if (!(v & reg_a)) {
+            mstatus.set(CpuFlag::Zero, true);
+        } else {
+            mstatus.set(CpuFlag::Zero, false);
+        }
+
+    });
+}
+
+void CPU::OpHandler_JMP(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("JMP", addrMode, [&](uint16_t index, uint8_t v) {
+        ip = index;
+    });
+}
+
+void CPU::OpHandler_JMPIndirect(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("JMP", addrMode, [&](uint16_t index, uint8_t v) {
+        uint16_t jmpAddress = ReadU16PageWrap(index);
+        ip = jmpAddress;
+    });
+}
+
+void CPU::OpHandler_STY(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("STY", addrMode, [&](uint16_t index, uint8_t v) {
+        WriteU8(index, reg_y);
+    });
+}
+
+void CPU::OpHandler_LDY(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("LDY", addrMode, [&](uint16_t index, uint8_t v) {
+        if (addrMode == OperandAddrMode::Immediate) {
+            reg_y = v;
+        } else {
+            reg_y = ReadU8(index);
+        }
+        RefreshStatusFromValue(reg_y);
+    });
+}
+
 void CPU::InitializeOpGroup01() {
     //
     // Setup opGroup handlers, these are called during decoding from 'TryDecodeOpGroup' when processing op-codes in
@@ -529,73 +648,68 @@ void CPU::InitializeOpGroup01() {
     //  7: "SBC"
 
     // Consider passing around and operand structure instead...
-    opGroup01.handlers[0] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("ORA", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_a |= v;
-            } else {
-                // Any non-immediate mode operand will load from memory..
-                reg_a |= ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_a);
-        });
-    };
+    opGroup01.handlers[0] = &CPU::OpHandler_ORA;
 
-    opGroup01.handlers[1] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("AND", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_a &= v;
-            } else {
-                // Any non-immediate mode operand will load from memory..
-                reg_a &= ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_a);
-        });
-    };
+    opGroup01.handlers[1] = &CPU::OpHandler_AND;
 
-    opGroup01.handlers[2] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("EOR", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_a ^= v;
-            } else {
-                // Any non-immediate mode operand will load from memory..
-                reg_a ^= ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_a);
-        });
-    };
+    opGroup01.handlers[2] = &CPU::OpHandler_EOR;
 
-    opGroup01.handlers[3] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("ADC", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateADC(addrMode, index, v);
-        });
-    };
+    opGroup01.handlers[3] = &CPU::OpHandler_ADC;
 
-    opGroup01.handlers[4] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("STA", addrMode, [&](uint16_t index, uint8_t v) {
-            // No immediate mode - just write whatever...
-            WriteU8(index, reg_a);
-        });
-    };
-    opGroup01.handlers[5] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("LDA", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_a = v;
-            } else {
-                // Any non-immediate mode operand will load from memory..
-                reg_a = ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_a);
-        });
-    };
+    opGroup01.handlers[4] = &CPU::OpHandler_STA;
+    opGroup01.handlers[5] = &CPU::OpHandler_LDA;
 
     // TODO: opGroup01 [6] = CMP
 
-    opGroup01.handlers[7] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("SBC", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateSBC(addrMode, index, v);
-        });
-    };
+    opGroup01.handlers[7] = &CPU::OpHandler_SBC;
+}
+
+void CPU::OpHandler_ORA(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("ORA", addrMode, [&](uint16_t index, uint8_t v) {
+        if (addrMode == OperandAddrMode::Immediate) {
+            reg_a |= v;
+        } else {
+            // Any non-immediate mode operand will load from memory..
+            reg_a |= ReadU8(index);
+        }
+        RefreshStatusFromValue(reg_a);
+    });
+}
+
+void CPU::OpHandler_AND(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("AND", addrMode, [&](uint16_t index, uint8_t v) {
+        if (addrMode == OperandAddrMode::Immediate) {
+            reg_a &= v;
+        } else {
+            // Any non-immediate mode operand will load from memory..
+            reg_a &= ReadU8(index);
+        }
+        RefreshStatusFromValue(reg_a);
+    });
+}
+
+void CPU::OpHandler_EOR(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("EOR", addrMode, [&](uint16_t index, uint8_t v) {
+        if (addrMode == OperandAddrMode::Immediate) {
+            reg_a ^= v;
+        } else {
+            // Any non-immediate mode operand will load from memory..
+            reg_a ^= ReadU8(index);
+        }
+        RefreshStatusFromValue(reg_a);
+    });
+}
+
+void CPU::OpHandler_ADC(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("ADC", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateADC(addrMode, index, v);
+    });
+}
+
+void CPU::OpHandler_SBC(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("SBC", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateSBC(addrMode, index, v);
+    });
 }
 
 void CPU::EmulateADC(OperandAddrMode addrMode, uint16_t index, uint8_t v) {
@@ -641,75 +755,91 @@ void CPU::EmulateSBC(OperandAddrMode addrMode, uint16_t index, uint8_t v) {
 void CPU::InitializeOpGroup10() {
 
     // ASL
-    opGroup10.handlers[0] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("ASL", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateASL(addrMode, index, v);
-        });
-    };
+    opGroup10.handlers[0] = &CPU::OpHandler_ASL;
 
     // ROL
-    opGroup10.handlers[1] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("ROL", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateROL(addrMode, index, v);
-        });
-    };
+    opGroup10.handlers[1] = &CPU::OpHandler_ROL;
 
     // LSR
-    opGroup10.handlers[2] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("LSR", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateLSR(addrMode, index, v);
-        });
-    };
+    opGroup10.handlers[2] = &CPU::OpHandler_LSR;
 
     // ROR
-    opGroup10.handlers[3] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("ROR", addrMode, [&](uint16_t index, uint8_t v) {
-            EmulateROR(addrMode, index, v);
-        });
-    };
+    opGroup10.handlers[3] = &CPU::OpHandler_ROR;
 
     // STX
-    opGroup10.handlers[4] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("STX", addrMode, [&](uint16_t index, uint8_t v) {
-            WriteU8(index, reg_x);
-        });
-    };
+    opGroup10.handlers[4] = &CPU::OpHandler_STX;
 
     // LDX
-    opGroup10.handlers[5] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("LDX", addrMode, [&](uint16_t index, uint8_t v) {
-            if (addrMode == OperandAddrMode::Immediate) {
-                reg_x = v;
-            } else {
-                // Any non-immediate mode operand will load from memory..
-                reg_x = ReadU8(index);
-            }
-            RefreshStatusFromValue(reg_x);
-        });
-    };
+    opGroup10.handlers[5] = &CPU::OpHandler_LDX;
 
     // DEC
-    opGroup10.handlers[6] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("DEC", addrMode, [&](uint16_t index, uint8_t v) {
-            // Any non-immediate mode operand will load from memory..
-            int val = ReadU8(index);
-            val = val - 1;
-            WriteU8(index, val & 255);
-            RefreshStatusFromValue(reg_x);
-        });
-    };
+    opGroup10.handlers[6] = &CPU::OpHandler_DEC;
 
     // INC
-    opGroup10.handlers[7] = [this](OperandAddrMode addrMode){
-        OperandResolveAddressAndExecute("INC", addrMode, [&](uint16_t index, uint8_t v) {
+    opGroup10.handlers[7] = &CPU::OpHandler_INC;
+
+}
+
+void CPU::OpHandler_ASL(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("ASL", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateASL(addrMode, index, v);
+    });
+}
+
+void CPU::OpHandler_ROL(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("ROL", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateROL(addrMode, index, v);
+    });
+}
+
+void CPU::OpHandler_LSR(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("LSR", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateLSR(addrMode, index, v);
+    });
+}
+
+void CPU::OpHandler_ROR(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("ROR", addrMode, [&](uint16_t index, uint8_t v) {
+        EmulateROR(addrMode, index, v);
+    });
+}
+
+void CPU::OpHandler_STX(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("STX", addrMode, [&](uint16_t index, uint8_t v) {
+        WriteU8(index, reg_x);
+    });
+}
+
+void CPU::OpHandler_LDX(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("LDX", addrMode, [&](uint16_t index, uint8_t v) {
+        if (addrMode == OperandAddrMode::Immediate) {
+            reg_x = v;
+        } else {
             // Any non-immediate mode operand will load from memory..
-            int val = ReadU8(index);
-            val = val + 1;
-            WriteU8(index, val & 255);
-            RefreshStatusFromValue(reg_x);
-        });
-    };
+            reg_x = ReadU8(index);
+        }
+        RefreshStatusFromValue(reg_x);
+    });
+}
+
+void CPU::OpHandler_DEC(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("DEC", addrMode, [&](uint16_t index, uint8_t v) {
+        // Any non-immediate mode operand will load from memory..
+        int val = ReadU8(index);
+        val = val - 1;
+        WriteU8(index, val & 255);
+        RefreshStatusFromValue(reg_x);
+    });
+}
 
+void CPU::OpHandler_INC(OperandAddrMode addrMode) {
+    OperandResolveAddressAndExecute("INC", addrMode, [&](uint16_t index, uint8_t v) {
+        // Any non-immediate mode operand will load from memory..
+        int val = ReadU8(index);
+        val = val + 1;
+        WriteU8(index, val & 255);
+        RefreshStatusFromValue(reg_x);
+    });
 }
 
 void CPU::EmulateLSR(OperandAddrMode addrMode, uint16_t index, uint8_t v) {
@@ -862,7 +992,7 @@ bool CPU::TryDecodeOpGroup(uint8_t incoming) {
     //printf("%s, sz: %d (op_base: %d)\n", name.c_str(), szOperand,op_base);
 
     if (opGroup->handlers[op_ext_idx] != nullptr) {
-        opGroup->handlers[op_ext_idx](opGroup->AddrMode(addrmode_idx));
+        (this->*opGroup->handlers[op_ext_idx])(opGroup->AddrMode(addrmode_idx));
     } else {
         if (szOperand > 1) {
             // Fetch remaining...
@@ -918,8 +1048,13 @@ bool CPU::TryDecodeLeftovers(uint8_t incoming) {
             }
             break;
         case CpuOperands::RTI : {
-                printf("RTI not supported!!!!!!!!!!!!!!!!!!\n");
-                exit(1);
+                auto tmp = static_cast<CpuFlags>(Pop8());
+                tmp.set(CpuFlag::Unused, false);
+                tmp.set(CpuFlag::BreakCmd, false);
+                mstatus = tmp;
+                uint16_t ofs = Pop16();
+                SetStepResult("RTI  (* -> $%04x)", ofs);
+                ip = ofs;
             }
             break;
         case CpuOperands::NOP : {
@@ -989,12 +1124,9 @@ void CPU::SetDebug(kDebugFlags flag, bool enable) {
 void CPU::SetStepResult(const char *format, ...) {
     va_list values;
     va_start(values, format);
-    char outstr[256];
-    vsnprintf(outstr, 256, format, values);
+    vsnprintf(lastStepResult, sizeof(lastStepResult), format, values);
     va_end(values);
 
-    lastStepResult = std::string(outstr);
-
 }
 
 // This will refresh the Zero/Neg flags in the status register...
@@ -1072,6 +1204,20 @@ uint16_t CPU::ReadU16(uint32_t index) {
     }
     return val;
 }
+uint16_t CPU::ReadU16ZeroPage(uint8_t index) {
+    uint16_t val = memory.ReadU16ZeroPage(index);
+    if((debugFlags & kDebugFlags::MemoryRead) == kDebugFlags::MemoryRead) {
+        printf("[CPU] Read16  0x%04x from zp: 0x%02x (%d)\n",  val, index, index);
+    }
+    return val;
+}
+uint16_t CPU::ReadU16PageWrap(uint32_t index) {
+    uint16_t val = memory.ReadU16PageWrap(index);
+    if((debugFlags & kDebugFlags::MemoryRead) == kDebugFlags::MemoryRead) {
+        printf("[CPU] Read16  0x%04x from ofs: 0x%04x (%d)\n",  val, index, index);
+    }
+    return val;
+}
 uint32_t CPU::ReadU32(uint32_t index) {
     uint32_t val = memory.ReadU32(index);
     if((debugFlags & kDebugFlags::MemoryRead) == kDebugFlags::MemoryRead) {
@@ -1102,75 +1248,6 @@ void CPU::WriteU32(uint32_t index, uint32_t value) {
     memory.WriteU32(index, value);
 }
 
-// Prepare and solve addressing scheme...
-// Action is called with INDEX = resolved addressing (all types), V = if required to read
-// This is used for any (more?) operands in opGroup 00, 01, 10
-// see: https://llx.com/Neil/a2/opcodes.html
-//
-// Will also call SetStepResult with string formatted properly (address, indexing, etc..)
-//
-void CPU::OperandResolveAddressAndExecute(const std::string &name, OperandAddrMode addrMode, OpHandlerActionDelegate Action) {
-    auto szOperand = OpAddrModeToSize(addrMode);
-    if ((szOperand == 1) && (addrMode == OperandAddrMode::Accumulator)) {
-        SetStepResult("%s a", name.c_str());
-        Action(0,0);
-    } else if (szOperand == 2) {
-        uint8_t v = Fetch8();
-        switch(addrMode) {
-            case OperandAddrMode::Immediate :
-                SetStepResult("%s #$%02x", name.c_str(), v);
-                Action(0, v);
-                break;
-            case OperandAddrMode::Zeropage :
-                SetStepResult("%s $%02x", name.c_str(), v);
-                Action(v,v);
-                break;
-            case OperandAddrMode::ZeropageX :
-                SetStepResult("%s $%02x,x",name.c_str(), v);
-                v += reg_x;
-                Action(v,v);
-                break;
-            case OperandAddrMode::ZeroPageIndX :
-                {
-                    SetStepResult("%s $(%02x,x)", name.c_str(), v);
-                    // Compute index in ZeroPage relative X
-                    v += reg_x;
-                    // Read final address as 16 bit from Zeropage
-                    uint16_t finalAddr = ReadU16(v);
-                    // Now perform action with final address...
-                    Action(finalAddr, v);
-                }
-                break;
-            case OperandAddrMode::ZeroPageIndY :
-                SetStepResult("%s $(%02x),y", name.c_str(), v);
-                v = ReadU16(v);
-                v += reg_y;
-                Action(v,ReadU8(v));
-                break;
-        }
-    } else if (szOperand == 3) {
-        uint16_t v = Fetch16();
-        switch(addrMode) {
-            case OperandAddrMode::Absolute :
-                SetStepResult("%s $%04x", name.c_str(), v);
-                Action(v,0);
-                break;
-            case OperandAddrMode::AbsoluteIndX :
-                SetStepResult("%s $%04x,x", name.c_str(), v);
-                v += reg_x;
-                Action(v, 0);
-                break;
-            case OperandAddrMode::AbsoluteIndY :
-                SetStepResult("%s $%04x,y", name.c_str(), v);
-                v += reg_y;
-                Action(v, 0);
-                break;
-        }
-
-    }
-
-}
-
 /// Template testing
 void CPU::OpHandler_LDA(OperandAddrMode addrMode) {
 
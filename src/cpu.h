@@ -12,8 +12,10 @@
 #include <functional>
 #include <bitset>
 #include <type_traits>
+#include <algorithm>
 
 #include "memory.h"
+#include "bus.h"
 
 //#define MAX_RAM (64*1024)
 enum class CpuOperands : uint8_t {
@@ -28,7 +30,7 @@ enum class CpuOperands : uint8_t {
     RTI = 0x40,
     PHA = 0x48,
     EOR_IMM = 0x49,
-    CLI = 0x48,
+    CLI = 0x58,
     RTS = 0x60,
     PLA = 0x68,
     ADC_IMM = 0x69,
@@ -173,13 +175,7 @@ enum class OperandAddrMode : uint8_t {
 
 class CPU {
 public:
-    using CPUInstruction = struct {
-        //uint8_t opCode;
-        CpuOperands opCode;
-        uint8_t bytes;
-        std::string name;
-        std::function<void()> exec;
-    };
+    using OpHandler = void (CPU::*)(OperandAddrMode addrMode);
 public:
     CPU(Memory &mem);
     void Initialize();
@@ -187,6 +183,18 @@ public:
     void Load(uint32_t offset, const uint8_t *from, uint32_t nbytes);
     bool Step();
     void Tick();
+    // Runs until 'cycle' reaches 'endCycle', same result as ticking each cycle as long as the bus (BA) doesn't
+    // change in between. 'cycle' is advanced per instruction, so I/O sees the cycle the instruction executes in.
+    // 'endCycle' is read again after every instruction, an instruction that schedules an earlier event (e.g. a VIC
+    // register write, see Scheduler::BurstEnd()) ends the burst there
+    void Run(uint64_t &cycle, const uint64_t &endCycle);
+    // Same, but stops before the next instruction when 'stop()' returns true (returns true in that case)
+    template<typename Predicate>
+    bool RunUntil(uint64_t &cycle, const uint64_t &endCycle, Predicate stop);
+    // Address of the next instruction
+    uint16_t PC() const { return static_cast<uint16_t>(ip); }
+    // The CPU is halted while the VIC has the bus, nullptr to disable
+    void ConnectBus(Bus *newBus) { bus = newBus; }
     const uint8_t *RAMPtr() const { return memory.RawPtr(); }
 
     void SetDebug(kDebugFlags flag, bool enable);
@@ -213,6 +221,8 @@ protected:
     uint32_t Fetch32();
     uint8_t ReadU8(uint32_t index);
     uint16_t ReadU16(uint32_t index);
+    uint16_t ReadU16ZeroPage(uint8_t index);
+    uint16_t ReadU16PageWrap(uint32_t index);
     uint32_t ReadU32(uint32_t index);
 //    void WriteU8(uint32_t index, uint8_t value);
     void WriteU16(uint32_t index, uint16_t value);
@@ -222,15 +232,41 @@ protected:
     void Push16(uint16_t value);
     uint8_t Pop8();
     uint16_t Pop16();
-private:
-    using OpHandlerActionDelegate = std::function<void(uint16_t index, uint8_t v)>;
-    void OperandResolveAddressAndExecute(const std::string &name, OperandAddrMode addrMode, OpHandlerActionDelegate Action);
-    void InitializeOpGroup01();
-    void InitializeOpGroup10();
-    void InitializeOpGroup00();
 
-    void OpHandler_LDA(OperandAddrMode addrMode);
+    void StartInstruction();
+    void HandleIRQ();
+private:
+    template<typename OpHandlerAction>
+    void OperandResolveAddressAndExecute(const char *name, OperandAddrMode addrMode, OpHandlerAction Action);
+    static void InitializeOpGroup01();
+    static void InitializeOpGroup10();
+    static void InitializeOpGroup00();
+
+    // OpGroup00
+    void OpHandler_Invalid(OperandAddrMode addrMode);
+    void OpHandler_BIT(OperandAddrMode addrMode);
+    void OpHandler_JMP(OperandAddrMode addrMode);
+    void OpHandler_JMPIndirect(OperandAddrMode addrMode);
+    void OpHandler_STY(OperandAddrMode addrMode);
+    void OpHandler_LDY(OperandAddrMode addrMode);
+    // OpGroup01
+    void OpHandler_ORA(OperandAddrMode addrMode);
+    void OpHandler_AND(OperandAddrMode addrMode);
+    void OpHandler_EOR(OperandAddrMode addrMode);
+    void OpHandler_ADC(OperandAddrMode addrMode);
     void OpHandler_STA(OperandAddrMode addrMode);
+    void OpHandler_LDA(OperandAddrMode addrMode);
+    void OpHandler_SBC(OperandAddrMode addrMode);
+    // OpGroup10
+    void OpHandler_ASL(OperandAddrMode addrMode);
+    void OpHandler_ROL(OperandAddrMode addrMode);
+    void OpHandler_LSR(OperandAddrMode addrMode);
+    void OpHandler_ROR(OperandAddrMode addrMode);
+    void OpHandler_STX(OperandAddrMode addrMode);
+    void OpHandler_LDX(OperandAddrMode addrMode);
+    void OpHandler_DEC(OperandAddrMode addrMode);
+    void OpHandler_INC(OperandAddrMode addrMode);
+
     // OpGroup01
     void EmulateADC(OperandAddrMode addrMode, uint16_t index, uint8_t v);
     void EmulateSBC(OperandAddrMode addrMode, uint16_t index, uint8_t v);
@@ -244,8 +280,10 @@ private:
 
 private:
     Memory &memory;
+    Bus *bus;
     CpuFlags mstatus;
     uint8_t instrCycleCount;
+    uint8_t baLowCycles;
 
     uint32_t ip;    // instruction pointer, index in RAM
     uint32_t sp;    // stack point, index in RAM
@@ -256,9 +294,36 @@ private:
 
     // Not releated to 6502
     kDebugFlags debugFlags;
-    std::string lastStepResult;
-    std::map<CpuOperands, CPUInstruction > instructions;
+    char lastStepResult[256];
 };
 
 
+// Whole instructions at a time, the per cycle path is only needed while BA is low
+template<typename Predicate>
+bool CPU::RunUntil(uint64_t &cycle, const uint64_t &endCycle, Predicate stop) {
+    if ((bus != nullptr) && bus->baLow) {
+        for(;cycle < endCycle;cycle++) {
+            if (!instrCycleCount && stop()) {
+                return true;
+            }
+            Tick();
+        }
+        return false;
+    }
+    baLowCycles = 0;
+    while(cycle < endCycle) {
+        if (!instrCycleCount) {
+            if (stop()) {
+                return true;
+            }
+            StartInstruction();
+        }
+        // An instruction crossing 'endCycle' finishes in the next burst, the instruction may have moved it back
+        auto n = (endCycle > cycle) ? static_cast<uint8_t>(std::min<uint64_t>(instrCycleCount, endCycle - cycle)) : 0;
+        instrCycleCount -= n;
+        cycle += n;
+    }
+    return false;
+}
+
 #endif //EMU6502_CPU_H
@@ -0,0 +1,70 @@
+//
+// Set of changed scan lines, used to upload only the parts of a texture that changed
+//
+
+#ifndef EMU6502_DIRTYROWS_H
+#define EMU6502_DIRTYROWS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <bit>
+
+class DirtyRows {
+public:
+    DirtyRows() = default;
+    explicit DirtyRows(size_t numRows) { Resize(numRows); }
+
+    void Resize(size_t numRows) {
+        nRows = numRows;
+        bits.assign((numRows + 63) / 64, 0);
+    }
+    void Clear() {
+        std::fill(bits.begin(), bits.end(), 0);
+    }
+    void SetAll() {
+        for(size_t i=0;i<nRows;i++) {
+            Set(i);
+        }
+    }
+    inline void Set(size_t row) { bits[row >> 6] |= uint64_t(1) << (row & 63); }
+    inline bool Test(size_t row) const { return (bits[row >> 6] >> (row & 63)) & 1; }
+
+    bool Any() const {
+        for(auto word : bits) {
+            if (word) return true;
+        }
+        return false;
+    }
+    size_t Count() const {
+        size_t n = 0;
+        for(auto word : bits) {
+            n += std::popcount(word);
+        }
+        return n;
+    }
+    size_t NumRows() const { return nRows; }
+
+    // Calls 'fn(firstRow, numRows)' for each run of consecutive dirty rows, top to bottom
+    template<typename F>
+    void ForEachSpan(F fn) const {
+        size_t row = 0;
+        while(row < nRows) {
+            if (!Test(row)) {
+                row++;
+                continue;
+            }
+            auto first = row;
+            while((row < nRows) && Test(row)) {
+                row++;
+            }
+            fn(first, row - first);
+        }
+    }
+private:
+    std::vector<uint64_t> bits;
+    size_t nRows = 0;
+};
+
+#endif //EMU6502_DIRTYROWS_H
@@ -0,0 +1,185 @@
+//
+// Asynchronous frame export, PNG sequence, Y4M video or a per frame hash log
+//
+#include <cstring>
+#include <algorithm>
+
+#include "framesink.h"
+#include "pngwriter.h"
+
+#define Y4M_FRAME_HEADER    "FRAME\n"
+
+// BT.601 studio range
+static void RGBToYUV(const RGBA &col, uint8_t yuv[3]) {
+    auto y = 16.0 + (65.481 * col.r + 128.553 * col.g + 24.966 * col.b) / 255.0;
+    auto u = 128.0 + (-37.797 * col.r - 74.203 * col.g + 112.0 * col.b) / 255.0;
+    auto v = 128.0 + (112.0 * col.r - 93.786 * col.g - 18.214 * col.b) / 255.0;
+    yuv[0] = static_cast<uint8_t>(std::clamp(y + 0.5, 0.0, 255.0));
+    yuv[1] = static_cast<uint8_t>(std::clamp(u + 0.5, 0.0, 255.0));
+    yuv[2] = static_cast<uint8_t>(std::clamp(v + 0.5, 0.0, 255.0));
+}
+
+FrameSink::FrameSink(Format format, const std::string &path, size_t width, size_t height, const RGBA *palette16, size_t queueDepth) :
+    format(format),
+    path(path),
+    width(width),
+    height(height),
+    fpsNumerator(50),
+    fpsDenominator(1),
+    file(nullptr),
+    slots(std::max<size_t>(queueDepth, 1)),
+    head(0),
+    tail(0),
+    wakeups(0),
+    stopping(false),
+    running(false),
+    nSubmitted(0),
+    nDropped(0),
+    nWritten(0) {
+
+    for(int i=0;i<16;i++) {
+        palette[i] = palette16[i];
+        RGBToYUV(palette[i], paletteYUV[i]);
+    }
+    for(auto &slot : slots) {
+        slot.frameNumber = 0;
+        slot.indices.resize(width * height);
+    }
+}
+
+FrameSink::~FrameSink() {
+    End();
+}
+
+void FrameSink::SetFrameRate(uint32_t numerator, uint32_t denominator) {
+    fpsNumerator = numerator;
+    fpsDenominator = denominator;
+}
+
+bool FrameSink::Begin() {
+    if (running) {
+        return true;
+    }
+    if (format != Format::PNG) {
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            printf("ERR: Unable to open file: %s\n", path.c_str());
+            return false;
+        }
+    }
+    if (format == Format::Y4M) {
+        fprintf(file, "YUV4MPEG2 W%zu H%zu F%u:%u Ip A1:1 C444\n", width, height, fpsNumerator, fpsDenominator);
+    }
+    head.store(0);
+    tail.store(0);
+    stopping.store(false);
+    running = true;
+    worker = std::thread(&FrameSink::Worker, this);
+    return true;
+}
+
+void FrameSink::End() {
+    if (!running) {
+        return;
+    }
+    stopping.store(true, std::memory_order_release);
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+    worker.join();
+    running = false;
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool FrameSink::Submit(const uint8_t *indices, size_t stride) {
+    if (!running) {
+        return false;
+    }
+    auto frameNumber = nSubmitted++;
+    auto h = head.load(std::memory_order_relaxed);
+    if ((h - tail.load(std::memory_order_acquire)) == slots.size()) {
+        nDropped++;
+        return false;
+    }
+    if (stride == 0) {
+        stride = width;
+    }
+    auto &slot = slots[h % slots.size()];
+    slot.frameNumber = frameNumber;
+    if (stride == width) {
+        memcpy(slot.indices.data(), indices, width * height);
+    } else {
+        for(size_t y=0;y<height;y++) {
+            memcpy(&slot.indices[y * width], &indices[y * stride], width);
+        }
+    }
+    head.store(h + 1, std::memory_order_release);
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+    return true;
+}
+
+void FrameSink::Worker() {
+    while(true) {
+        // Read the wake up counter before checking, a submit in between makes the wait return immediately
+        auto nWakeups = wakeups.load(std::memory_order_acquire);
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            if (stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+            wakeups.wait(nWakeups, std::memory_order_acquire);
+            continue;
+        }
+        WriteFrame(slots[t % slots.size()]);
+        nWritten.fetch_add(1, std::memory_order_relaxed);
+        tail.store(t + 1, std::memory_order_release);
+    }
+    if (file) {
+        fflush(file);
+    }
+}
+
+bool FrameSink::WriteFrame(const Slot &slot) {
+    switch(format) {
+        case Format::PNG :
+            return WritePNG(slot);
+        case Format::Y4M :
+            return WriteY4M(slot);
+        case Format::Hash :
+            return WriteHash(slot);
+    }
+    return false;
+}
+
+bool FrameSink::WritePNG(const Slot &slot) {
+    rgba.resize(width * height * sizeof(RGBA));
+    auto dst = reinterpret_cast<RGBA *>(rgba.data());
+    for(size_t i=0;i<width * height;i++) {
+        dst[i] = palette[slot.indices[i] & 0x0f];
+    }
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%06llu.png", (unsigned long long)slot.frameNumber);
+    return PNGWriter::WriteRGBA(path + filename, rgba.data(), width, height);
+}
+
+// Planar, full resolution chroma (C444) - no subsampling of the 8 pixel wide characters
+bool FrameSink::WriteY4M(const Slot &slot) {
+    auto nPixels = width * height;
+    planes.resize(nPixels * 3);
+    for(size_t i=0;i<nPixels;i++) {
+        auto &yuv = paletteYUV[slot.indices[i] & 0x0f];
+        planes[i] = yuv[0];
+        planes[nPixels + i] = yuv[1];
+        planes[nPixels * 2 + i] = yuv[2];
+    }
+    fwrite(Y4M_FRAME_HEADER, 1, strlen(Y4M_FRAME_HEADER), file);
+    return fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+}
+
+bool FrameSink::WriteHash(const Slot &slot) {
+    auto crc = PNGWriter::CRC32(slot.indices.data(), slot.indices.size());
+    return fprintf(file, "%06llu %08x\n", (unsigned long long)slot.frameNumber, crc) > 0;
+}
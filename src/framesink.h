@@ -0,0 +1,87 @@
+//
+// Asynchronous frame export, PNG sequence, Y4M video or a per frame hash log
+//
+
+#ifndef EMU6502_FRAMESINK_H
+#define EMU6502_FRAMESINK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "Pixmap.h"
+
+//
+// Frames are copied in to a bounded single producer/single consumer ring and encoded by a worker thread.
+// Submit() never blocks - when the worker can't keep up the frame is dropped (and counted).
+// Frames are palette indices (VIC::Frame()), the RGBA/YUV conversion is done by the worker as well.
+//
+class FrameSink {
+public:
+    enum class Format : uint8_t {
+        PNG = 0,        // <path>000000.png, <path>000001.png, ...
+        Y4M = 1,        // YUV4MPEG2 4:4:4 stream, plays with ffplay/mpv
+        Hash = 2,       // one line per frame: <frame> <crc32 of the indices>
+    };
+public:
+    FrameSink(Format format, const std::string &path, size_t width, size_t height, const RGBA *palette16, size_t queueDepth = 8);
+    ~FrameSink();
+    FrameSink(const FrameSink &) = delete;
+    FrameSink &operator=(const FrameSink &) = delete;
+
+    // Opens the output and starts the worker
+    bool Begin();
+    // Drains the queue and stops the worker
+    void End();
+
+    // Copies 'indices' (width x height, 'stride' bytes per row - 0 means width), false if the frame was dropped
+    bool Submit(const uint8_t *indices, size_t stride = 0);
+    // Frame rate written to the Y4M header, e.g. 50125/1000 for PAL
+    void SetFrameRate(uint32_t numerator, uint32_t denominator);
+
+    uint64_t FramesSubmitted() const { return nSubmitted; }
+    uint64_t FramesDropped() const { return nDropped; }
+    uint64_t FramesWritten() const { return nWritten.load(std::memory_order_relaxed); }
+private:
+    struct Slot {
+        uint64_t frameNumber;
+        std::vector<uint8_t> indices;
+    };
+    void Worker();
+    bool WriteFrame(const Slot &slot);
+    bool WritePNG(const Slot &slot);
+    bool WriteY4M(const Slot &slot);
+    bool WriteHash(const Slot &slot);
+private:
+    Format format;
+    std::string path;
+    size_t width;
+    size_t height;
+    RGBA palette[16];
+    uint8_t paletteYUV[16][3];
+    uint32_t fpsNumerator;
+    uint32_t fpsDenominator;
+    FILE *file;
+    std::vector<uint8_t> rgba;      // worker only, PNG conversion buffer
+    std::vector<uint8_t> planes;    // worker only, Y4M conversion buffer
+
+    std::vector<Slot> slots;
+    // head is written by the producer, tail by the worker - both count frames since Begin()
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // Bumped on every submit and on End(), the worker sleeps on it while the ring is empty
+    std::atomic<uint32_t> wakeups;
+    std::atomic<bool> stopping;
+    std::thread worker;
+    bool running;
+
+    uint64_t nSubmitted;
+    uint64_t nDropped;
+    std::atomic<uint64_t> nWritten;
+};
+
+#endif //EMU6502_FRAMESINK_H
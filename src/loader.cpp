@@ -0,0 +1,199 @@
+//
+// ROM and program image loading
+//
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <iterator>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "loader.h"
+
+// Expected ROM sizes
+static const size_t romSizes[] = {
+        8192,   // Basic
+        8192,   // Kernal
+        4096,   // CharGen
+};
+
+//
+// MappedFile
+//
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string &filename) {
+    Close();
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    hFile = file;
+    LARGE_INTEGER szFile;
+    if (!GetFileSizeEx(hFile, &szFile) || (szFile.QuadPart == 0)) {
+        Close();
+        return false;
+    }
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == nullptr) {
+        Close();
+        return false;
+    }
+    data = reinterpret_cast<const uint8_t *>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        Close();
+        return false;
+    }
+    size = szFile.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (hMapping != nullptr) {
+        CloseHandle(hMapping);
+    }
+    if (hFile != nullptr) {
+        CloseHandle(hFile);
+    }
+    data = nullptr;
+    size = 0;
+    hMapping = nullptr;
+    hFile = nullptr;
+}
+#else
+bool MappedFile::Open(const std::string &filename) {
+    Close();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+    // The descriptor is not needed once the file is mapped
+    auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    data = reinterpret_cast<const uint8_t *>(ptr);
+    size = st.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+}
+#endif
+
+//
+// Loader
+//
+const MappedFile *Loader::MapROMImage(const std::string &filename) {
+    static std::mutex lock;
+    static std::map<std::string, std::unique_ptr<MappedFile>> images;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = images.find(filename);
+    if (it != images.end()) {
+        return it->second.get();
+    }
+    auto image = std::make_unique<MappedFile>();
+    if (!image->Open(filename)) {
+        return nullptr;
+    }
+    auto ptrImage = image.get();
+    images[filename] = std::move(image);
+    return ptrImage;
+}
+
+const MappedFile *Loader::MapROM(Memory::Rom rom, const std::string &filename, bool reportMissing) {
+    auto image = MapROMImage(filename);
+    if (image == nullptr) {
+        if (reportMissing) {
+            printf("ERR: Unable to map ROM: %s\n", filename.c_str());
+        }
+        return nullptr;
+    }
+    auto szExpected = romSizes[static_cast<size_t>(rom)];
+    if (image->Size() != szExpected) {
+        printf("ERR: Invalid ROM size for %s, expected %zu got %zu bytes\n", filename.c_str(), szExpected, image->Size());
+        return nullptr;
+    }
+    return image;
+}
+
+bool Loader::AttachROM(Memory &memory, Memory::Rom rom, const std::string &filename) {
+    auto image = MapROM(rom, filename, true);
+    if (image == nullptr) {
+        return false;
+    }
+    memory.SetROM(rom, image->Data());
+    return true;
+}
+
+bool Loader::AttachROMs(Memory &memory, const std::string &path, bool optional) {
+    static const std::pair<Memory::Rom, const char *> romFiles[] = {
+        { Memory::Rom::Basic, "/basic.rom" },
+        { Memory::Rom::Kernal, "/kernal.rom" },
+        { Memory::Rom::CharGen, "/chargen.rom" },
+    };
+    // All are mapped before any is attached, KERNAL without BASIC (or the other way around) doesn't run
+    const MappedFile *images[std::size(romFiles)];
+    for(size_t i=0;i<std::size(romFiles);i++) {
+        images[i] = MapROM(romFiles[i].first, path + romFiles[i].second, !optional);
+        if (images[i] == nullptr) {
+            return false;
+        }
+    }
+    for(size_t i=0;i<std::size(romFiles);i++) {
+        memory.SetROM(romFiles[i].first, images[i]->Data());
+    }
+    return true;
+}
+
+uint16_t Loader::LoadPRG(Memory &memory, const std::string &filename) {
+    MappedFile file;
+    if (!file.Open(filename)) {
+        printf("ERR: Unable to open file: %s\n", filename.c_str());
+        return 0;
+    }
+    if (file.Size() < 3) {
+        printf("ERR: Invalid PRG file: %s\n", filename.c_str());
+        return 0;
+    }
+    // First two bytes is the load address
+    uint16_t offset = file.Data()[0] | (file.Data()[1] << 8);
+    size_t nBytes = file.Size() - 2;
+    if ((offset + nBytes) > 0x10000) {
+        printf("ERR: PRG file too large: %s\n", filename.c_str());
+        return 0;
+    }
+    printf("Offset: $%02x, reading: %zd bytes\n", offset, nBytes);
+    memory.CopyTo(offset, file.Data() + 2, nBytes);
+    return offset;
+}
@@ -0,0 +1,59 @@
+//
+// ROM and program image loading
+//
+
+#ifndef EMU6502_LOADER_H
+#define EMU6502_LOADER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "memory.h"
+
+//
+// Read-only memory mapped file, the mapping is shared - all processes mapping the same file share the
+// physical pages through the OS page cache.
+//
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool Open(const std::string &filename);
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+    const uint8_t *Data() const { return data; }
+    size_t Size() const { return size; }
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    // HANDLEs, keeps <windows.h> out of the header
+    void *hFile = nullptr;
+    void *hMapping = nullptr;
+#endif
+};
+
+//
+// ROM images are mapped once per process and cached, the ROM pages are banked in directly from the mapping
+// without any copying. The images stay mapped for the lifetime of the process.
+//
+class Loader {
+public:
+    // Maps a ROM image and attaches it to memory, returns false if the file is missing or has the wrong size
+    static bool AttachROM(Memory &memory, Memory::Rom rom, const std::string &filename);
+    // Attaches 'basic.rom', 'kernal.rom' and 'chargen.rom' from a directory, all of them or none (returns false).
+    // 'optional' - missing files are not reported, only broken ones
+    static bool AttachROMs(Memory &memory, const std::string &path, bool optional = false);
+    // Loads a PRG file to correct location and returns the address, 0 on error
+    static uint16_t LoadPRG(Memory &memory, const std::string &filename);
+private:
+    static const MappedFile *MapROMImage(const std::string &filename);
+    static const MappedFile *MapROM(Memory::Rom rom, const std::string &filename, bool reportMissing);
+};
+
+#endif //EMU6502_LOADER_H
@@ -0,0 +1,118 @@
+//
+// The whole machine, owns the chips and runs them on one clock
+//
+#include <cstdio>
+
+#include "machine.h"
+#include "loader.h"
+#include "framesink.h"
+
+template<const VICModel &model>
+Machine<model>::Machine(VICGeometry geometry) :
+    vic(memory, geometry),
+    cpu(memory) {
+
+    Connect();
+}
+
+template<const VICModel &model>
+Machine<model>::Machine(uint8_t *ptrRamBuffer, void *ptrScreenBuffer, VICGeometry geometry) :
+    memory(ptrRamBuffer, EMU6502_RAM_SIZE),
+    vic(memory, ptrScreenBuffer, geometry),
+    cpu(memory) {
+
+    Connect();
+}
+
+template<const VICModel &model>
+void Machine<model>::Connect() {
+    vic.ConnectBus(&bus);
+    cpu.ConnectBus(&bus);
+    cpu.Initialize();
+    vic.ConnectScheduler(&scheduler);
+    // After the VIC events, so the VIC has started the frame when this fires
+    evFrame = scheduler.Register(&Machine::OnFrameEvent, this);
+}
+
+template<const VICModel &model>
+bool Machine<model>::AddFrameSink(FrameSink *sink) {
+    if (nFrameSinks == kMaxFrameSinks) {
+        printf("ERR: Machine, too many frame sinks (max %zu)\n", kMaxFrameSinks);
+        return false;
+    }
+    frameSinks[nFrameSinks++] = sink;
+    if (nFrameSinks == 1) {
+        nFramesSubmitted = vic.FramesRendered();
+        scheduler.ScheduleIn(evFrame, CyclesToNextFrame());
+    }
+    return true;
+}
+
+template<const VICModel &model>
+void Machine<model>::RemoveFrameSink(FrameSink *sink) {
+    auto last = std::remove(frameSinks, frameSinks + nFrameSinks, sink);
+    nFrameSinks = last - frameSinks;
+    if (nFrameSinks == 0) {
+        scheduler.Cancel(evFrame);
+    }
+}
+
+// Frames skipped by the render interval (warp) are not submitted, the sinks would only get duplicates
+template<const VICModel &model>
+void Machine<model>::OnFrameEvent(void *context) {
+    auto machine = static_cast<Machine *>(context);
+    auto &vic = machine->vic;
+    vic.CatchUp();
+    if (vic.FramesRendered() != machine->nFramesSubmitted) {
+        machine->nFramesSubmitted = vic.FramesRendered();
+        for(size_t i=0;i<machine->nFrameSinks;i++) {
+            machine->frameSinks[i]->Submit(vic.Frame());
+        }
+    }
+    machine->scheduler.ScheduleIn(machine->evFrame, kCyclesPerFrame);
+}
+
+// Cycles until the start of the next frame (line 0, cycle 0), zero when already there
+template<const VICModel &model>
+uint64_t Machine<model>::CyclesToNextFrame() {
+    vic.CatchUp();
+    return (uint64_t(model.nVerticalLines - vic.RasterY()) * model.cyclesPerLine - vic.RasterX()) % kCyclesPerFrame;
+}
+
+template<const VICModel &model>
+void Machine<model>::Load(uint16_t address, const uint8_t *data, size_t nBytes) {
+    cpu.Load(address, data, nBytes);
+    Reset(address);
+}
+
+template<const VICModel &model>
+bool Machine<model>::LoadPRG(const std::string &filename) {
+    auto address = Loader::LoadPRG(memory, filename);
+    if (!address) {
+        return false;
+    }
+    Reset(address);
+    return true;
+}
+
+template<const VICModel &model>
+void Machine<model>::Reset(uint16_t address) {
+    cpu.Reset(address);
+}
+
+template<const VICModel &model>
+void Machine<model>::RunFrame() {
+    // Where the VIC is now decides how far the frame end is
+    auto cyclesLeft = CyclesToNextFrame();
+    RunTo(scheduler.Now() + (cyclesLeft ? cyclesLeft : kCyclesPerFrame), []() { return false; });
+}
+
+template<const VICModel &model>
+void Machine<model>::RunCycles(uint64_t nCycles) {
+    RunTo(scheduler.Now() + nCycles, []() { return false; });
+}
+
+template class Machine<VICModels::MOS6569>;
+template class Machine<VICModels::MOS6567R8>;
+template class Machine<VICModels::MOS6567R56A>;
+template class Machine<VICModels::MOS6572>;
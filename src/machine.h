@@ -0,0 +1,119 @@
+//
+// The whole machine, owns the chips and runs them on one clock
+//
+
+#ifndef EMU6502_MACHINE_H
+#define EMU6502_MACHINE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+
+#include "memory.h"
+#include "bus.h"
+#include "scheduler.h"
+#include "cpu.h"
+#include "vic.h"
+
+class FrameSink;
+
+//
+// CPU, VIC and Memory wired through the bus and the scheduler. The VIC runs from events (see VIC::ConnectScheduler),
+// the CPU in bursts between them - this is the only main loop, everything else (UI, farms, warp) drives it through
+// RunFrame(), RunCycles() and RunUntil().
+// Templated on the VIC model and the RunUntil() predicate, so the inner loop is fully inlined - the only indirect
+// calls left are the scheduler events and memory mapped I/O.
+//
+template<const VICModel &model>
+class Machine {
+public:
+    using VideoChip = VICII<model>;
+    static const size_t kMaxFrameSinks = 4;
+    static constexpr uint64_t kCyclesPerFrame = uint64_t(model.cyclesPerLine) * model.nVerticalLines;
+public:
+    explicit Machine(VICGeometry geometry = VICGeometry::Full);
+    // RAM and screen in external buffers (e.g. from an arena), 'ptrRamBuffer' must be at least Memory::BufferSize()
+    // and 'ptrScreenBuffer' VideoChip::ExternalBufferSize() bytes - not owned
+    Machine(uint8_t *ptrRamBuffer, void *ptrScreenBuffer, VICGeometry geometry = VICGeometry::Full);
+    Machine(const Machine &) = delete;
+    Machine &operator=(const Machine &) = delete;
+
+    // Copies 'data' to RAM and starts the CPU at 'address'
+    void Load(uint16_t address, const uint8_t *data, size_t nBytes);
+    // Loads a PRG and starts the CPU at its load address, false on error
+    bool LoadPRG(const std::string &filename);
+    void Reset(uint16_t address);
+
+    // Every rendered frame is submitted to the sinks (see FrameSink) at the start of the next frame - not owned.
+    // Sinks must be started (FrameSink::Begin()) by the caller, false if there are already kMaxFrameSinks
+    bool AddFrameSink(FrameSink *sink);
+    void RemoveFrameSink(FrameSink *sink);
+
+    // Runs to the start of the next frame (line 0, cycle 0), the completed frame is in GetVIC().Frame()
+    void RunFrame();
+    void RunCycles(uint64_t nCycles);
+    // Runs until 'stop()' returns true or 'maxCycles' have passed, returns true if stopped by the predicate.
+    // The predicate is checked before each instruction, e.g. [&]() { return machine.GetCPU().PC() == 0x0810; }
+    template<typename Predicate>
+    bool RunUntil(Predicate stop, uint64_t maxCycles = Scheduler::kNever);
+
+    Memory &GetMemory() { return memory; }
+    CPU &GetCPU() { return cpu; }
+    VideoChip &GetVIC() { return vic; }
+    Bus &GetBus() { return bus; }
+    Scheduler &GetScheduler() { return scheduler; }
+    uint64_t Cycles() const { return scheduler.Now(); }
+private:
+    void Connect();
+    uint64_t CyclesToNextFrame();
+    static void OnFrameEvent(void *context);
+    template<typename Predicate>
+    bool RunTo(uint64_t endCycle, Predicate stop);
+private:
+    Bus bus;
+    Scheduler scheduler;
+    Memory memory;
+    VideoChip vic;
+    CPU cpu;
+
+    Scheduler::EventId evFrame = Scheduler::kInvalidEvent;
+    FrameSink *frameSinks[kMaxFrameSinks] = {};
+    size_t nFrameSinks = 0;
+    uint64_t nFramesSubmitted = 0;  // VIC::FramesRendered() at the last submit
+};
+
+// Events due at 'endCycle' are dispatched before returning, so the chips are up to date with Cycles()
+template<const VICModel &model>
+template<typename Predicate>
+bool Machine<model>::RunTo(uint64_t endCycle, Predicate stop) {
+    auto &clock = scheduler.Clock();
+    auto &burstEnd = scheduler.BurstEnd();
+    while(true) {
+        scheduler.Dispatch();
+        if (clock >= endCycle) {
+            return false;
+        }
+        burstEnd = std::min<uint64_t>(scheduler.NextEventCycle(), endCycle);
+        if (cpu.RunUntil(clock, burstEnd, stop)) {
+            return true;
+        }
+    }
+}
+
+template<const VICModel &model>
+template<typename Predicate>
+bool Machine<model>::RunUntil(Predicate stop, uint64_t maxCycles) {
+    auto endCycle = (maxCycles > (Scheduler::kNever - scheduler.Now())) ? Scheduler::kNever : scheduler.Now() + maxCycles;
+    return RunTo(endCycle, stop);
+}
+
+extern template class Machine<VICModels::MOS6569>;
+extern template class Machine<VICModels::MOS6567R8>;
+extern template class Machine<VICModels::MOS6567R56A>;
+extern template class Machine<VICModels::MOS6572>;
+
+using MachinePAL = Machine<VICModels::MOS6569>;
+using MachineNTSC = Machine<VICModels::MOS6567R8>;
+
+#endif //EMU6502_MACHINE_H
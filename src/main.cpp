@@ -6,11 +6,19 @@
 #include <cstdio>
 #include <string>
 #include <cstdarg>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include "imgui.h"
 #include "Pixmap.h"
 
 #include "vic.h"
 #include "cpu.h"
+#include "loader.h"
+#include "pacer.h"
+#include "machine.h"
+#include "framesink.h"
 
 static void HexDump(const uint8_t *ptr, size_t ofs, size_t len);
 
@@ -20,6 +28,7 @@ void ui_unlocktexture(int idTexture);
 extern void *ui_gettexturehandle(int idText);
 extern int ui_createtexture(size_t width, size_t height);
 extern void ui_updatetexture(int idTexture, const void *ptrData, const size_t width, const size_t height);
+extern void ui_updatetexturerows(int idTexture, const void *ptrData, const size_t width, const size_t height, const size_t firstRow, const size_t nRows);
 
 extern int ui_initialize();
 extern bool ui_beginframe();
@@ -48,40 +57,6 @@ static void HexDump(const uint8_t *ptr, size_t ofs, size_t len) {
     }
 }
 
-static long fsize(FILE *f) {
-    long curPos = ftell(f);
-    fseek(f,0,SEEK_END);
-    auto szfile = ftell(f);
-    fseek(f,curPos,SEEK_SET);
-    return szfile;
-}
-
-//
-// Loads a PRG file to correct location and returns the address
-//
-static uint16_t LoadPRG(const std::string &filename, CPU &cpu) {
-    auto f = fopen(filename.c_str(), "rb");
-    if (!f) {
-        printf("ERR: Unable to open file: %s\n", filename.c_str());
-        return 0;
-    }
-    auto szfile = fsize(f);
-    uint8_t *buffer = reinterpret_cast<uint8_t *>(malloc(szfile - 2));
-    if (buffer == nullptr) {
-        fclose(f);
-        return 0;
-    }
-    uint16_t offset = 0;
-    fread(&offset, 2, 1, f);
-    // Now read the rest...
-    printf("Offset: $%02x, reading: %zd bytes\n", offset, szfile-2);
-    fread(buffer, szfile-2, 1, f);
-    fclose(f);
-
-    cpu.Load(offset, buffer, szfile-2);
-    return offset;
-}
-
 static uint8_t bincode[]={
         0xa9,0xff,
         0x8d,0x80,0x00,
@@ -89,31 +64,112 @@ static uint8_t bincode[]={
 };
 
 
-static void renderVICStats(const VIC &videochip) {
+// JMP * - keeps the CPU busy until there is something real to run
+static const uint16_t idleLoopAddress = 0x0810;
+static uint8_t idleLoop[]={
+        0x4c,0x10,0x08,
+};
+
+// Host side raster bars, runs as a scheduler event at the start of every line (after the VIC)
+struct RasterBars {
+    static void OnLine(void *context) {
+        static const uint8_t colors[]={
+                VIC::Black,
+                VIC::DarkGray,
+                VIC::MediumGray,
+                VIC::LightGray,
+                VIC::White,
+                VIC::LightGray,
+                VIC::MediumGray,
+                VIC::DarkGray,
+        };
+        auto bars = static_cast<RasterBars *>(context);
+        auto raster = bars->memory->ReadU8(VIC::Raster);
+        if ((raster > 0x40)  && (raster < 0x80)) {
+            bars->memory->WriteU8(VIC::BorderCol, colors[raster & 0x07]);
+        }
+        if (raster == 0xc0) {
+            bars->memory->WriteU8(VIC::BorderCol, VIC::LightBlue);
+        }
+        bars->scheduler->ScheduleIn(bars->idEvent, VIC::kModel.cyclesPerLine);
+    }
+    Memory *memory;
+    Scheduler *scheduler;
+    Scheduler::EventId idEvent;
+};
 
-    static auto rx = videochip.RasterX();
-    static auto ry = videochip.RasterY();
+static void renderEmulationStats(FramePacer &pacer) {
+    ImGui::Begin("Emulation");
+    ImGui::SetWindowSize({320,200});
 
-    ImGui::Begin("VIC");
-    ImGui::SetWindowSize({512,480});
+    ImGui::Text("Model: %s", VIC::kModel.name);
+    ImGui::Text("Frames: %llu", (unsigned long long)pacer.Frames());
+    ImGui::Text("Target: %.3f Hz", pacer.FrameRate() * pacer.Speed());
+    ImGui::Text("Actual: %.3f Hz", pacer.MeasuredFrameRate());
 
-    ImGui::Text("RasterX: %d", rx);
-    ImGui::Text("RasterY: %d", ry);
+    bool turbo = pacer.Turbo();
+    if (ImGui::Checkbox("Turbo", &turbo)) {
+        pacer.SetTurbo(turbo);
+    }
+    float speed = float(pacer.Speed());
+    if (ImGui::SliderFloat("Speed", &speed, 0.25f, 4.0f, "%.2fx")) {
+        pacer.SetSpeed(speed);
+    }
     ImGui::End();
 }
 
 
-static void testui() {
+// Frames are exported from the emulation thread as they complete, see Machine::AddFrameSink
+static std::unique_ptr<FrameSink> startFrameSink(MachinePAL &machine, FrameSink::Format format, const std::string &path) {
+    auto &videoChip = machine.GetVIC();
+    auto sink = std::make_unique<FrameSink>(format, path, videoChip.ScreenWidth(), videoChip.ScreenHeight(), VIC::Palette());
+    sink->SetFrameRate(VIC::kModel.cpuClockHz, VIC::kModel.cyclesPerLine * VIC::kModel.nVerticalLines);
+    if (!sink->Begin()) {
+        return nullptr;
+    }
+    machine.AddFrameSink(sink.get());
+    return sink;
+}
 
-    Memory memory;          // Initialize memory with default size (64k)
-    VIC videoChip(memory);
+static void stopFrameSink(MachinePAL &machine, std::unique_ptr<FrameSink> &sink) {
+    if (sink == nullptr) {
+        return;
+    }
+    machine.RemoveFrameSink(sink.get());
+    sink->End();
+    printf("Frames: %llu written, %llu dropped\n", (unsigned long long)sink->FramesWritten(), (unsigned long long)sink->FramesDropped());
+    sink.reset();
+}
 
-    videoChip.Tick();
-    ui_initialize();
+static void testui(bool turbo, double speed, const std::string &recordPath, const std::string &hashLogPath) {
+
+    MachinePAL machine(VICGeometry::Visible);     // Border included, no blanking
+    auto &memory = machine.GetMemory();
+    auto &videoChip = machine.GetVIC();
+
+    // ROM's are optional, without them the memory is plain RAM
+    Loader::AttachROMs(memory, "roms", true);
+    machine.Load(idleLoopAddress, idleLoop, sizeof(idleLoop));
 
-    auto screenPmap = videoChip.Screen();
+    RasterBars rasterBars = {&memory, &machine.GetScheduler(), 0};
+    rasterBars.idEvent = machine.GetScheduler().Register(&RasterBars::OnLine, &rasterBars);
+    machine.GetScheduler().Schedule(rasterBars.idEvent, machine.GetScheduler().NextEventCycle());
+
+    // A '.y4m' file records video, anything else is the prefix of a PNG sequence
+    std::unique_ptr<FrameSink> recorder, hashLog;
+    if (!recordPath.empty()) {
+        auto isY4M = (recordPath.size() > 4) && (recordPath.compare(recordPath.size() - 4, 4, ".y4m") == 0);
+        recorder = startFrameSink(machine, isY4M ? FrameSink::Format::Y4M : FrameSink::Format::PNG, recordPath);
+    }
+    if (!hashLogPath.empty()) {
+        hashLog = startFrameSink(machine, FrameSink::Format::Hash, hashLogPath);
+    }
+
+    ui_initialize();
 
-    int idTexture = ui_createtexture(screenPmap.Width(),screenPmap.Height());
+    // The screen is upscaled 2x on the CPU, the texture is shown 1:1
+    Pixmap scaledScreen(videoChip.ScreenWidth() * 2, videoChip.ScreenHeight() * 2);
+    int idTexture = ui_createtexture(scaledScreen.Width(), scaledScreen.Height());
     void *hTexture = ui_gettexturehandle(idTexture);
 
 
@@ -131,34 +187,28 @@ static void testui() {
     ImFont* font1 = io.Fonts->AddFontFromFileTTF("assets/PetMe64.ttf", 12, &config);
 
 
-    static uint8_t rasterBar[]={
-            VIC::Black,
-            VIC::DarkGray,
-            VIC::MediumGray,
-            VIC::LightGray,
-            VIC::White,
-            VIC::LightGray,
-            VIC::MediumGray,
-            VIC::DarkGray,
-    };
+    // The machine runs on its own thread paced to the frame rate of the VIC model, the UI only presents
+    // whatever frame was completed last - a slow UI no longer slows down the emulation
+    FramePacer pacer(VIC::kModel.FrameRate());
+    pacer.SetTurbo(turbo);
+    pacer.SetSpeed(speed);
+    std::atomic<bool> quit = false;
+
+    std::thread emulation([&]() {
+        pacer.Reset();
+        while(!quit.load(std::memory_order_relaxed)) {
+            machine.RunFrame();
+            pacer.WaitForNextFrame();
+        }
+    });
+
     bool done = false;
     while(!done) {
 
         done = ui_beginframe();
         if (done) continue;
-        for(int i=0;i<63*312;i++) {
-            videoChip.Tick();
-            // Test if the raster works
-            if ((memory[VIC::Raster] > 0x40)  && (memory[VIC::Raster] < 0x80)) {
-                uint8_t idxCol = memory[VIC::Raster] & 0x07;
-                memory[VIC::BorderCol] = rasterBar[idxCol];
-            }
-            if (memory[VIC::Raster] == 0xc0) {
-                memory[VIC::BorderCol] = VIC::LightBlue;
-            }
-        }
 
-        renderVICStats(videoChip);
+        renderEmulationStats(pacer);
 
 
         ImGui::Begin("TEXT");
@@ -171,10 +221,16 @@ static void testui() {
 //        auto x = (int)(128+128 * sin(ImGui::GetTime()));
 //        pmap.PutPixel(x, 128, Pixmap::White);
 
-        ui_updatetexture(idTexture, screenPmap.Data(), screenPmap.Width(), screenPmap.Height());
+        // Latest completed frame through the triple buffer, converted to RGBA when it changed
+        auto &screenPmap = videoChip.PresentedScreen();
+        // Only rows that changed since the last presented frame are scaled and uploaded
+        videoChip.PresentedDirtyRows().ForEachSpan([&](size_t firstRow, size_t nRows) {
+            scaledScreen.ScaleNearest(screenPmap, 2, firstRow, nRows);
+            ui_updatetexturerows(idTexture, scaledScreen.Data(), scaledScreen.Width(), scaledScreen.Height(), firstRow * 2, nRows * 2);
+        });
         //ui_unlocktexture(idTexture);
 
-        ImGui::Image(hTexture, ImVec2(screenPmap.Width()*2,screenPmap.Height()*2));
+        ImGui::Image(hTexture, ImVec2(scaledScreen.Width(),scaledScreen.Height()));
 
 /*
         //
@@ -198,6 +254,11 @@ static void testui() {
     }
     printf("ui end loop\n");
 
+    quit.store(true, std::memory_order_relaxed);
+    emulation.join();
+    stopFrameSink(machine, recorder);
+    stopFrameSink(machine, hashLog);
+
     ui_close();
 }
 
@@ -217,7 +278,24 @@ int main(int argc, char **argv) {
 //    }
 //    exit(1);
 
-    testui();
+    // --turbo runs unthrottled, --speed=<multiplier> scales real time (e.g. 0.5 for remote desktops)
+    // --record=<file.y4m | png prefix> records the frames, --hashlog=<file> writes a CRC per frame
+    bool turbo = false;
+    double speed = 1.0;
+    std::string recordPath;
+    std::string hashLogPath;
+    for(int i=1;i<argc;i++) {
+        if (!strcmp(argv[i], "--turbo")) {
+            turbo = true;
+        } else if (!strncmp(argv[i], "--speed=", 8)) {
+            speed = atof(argv[i] + 8);
+        } else if (!strncmp(argv[i], "--record=", 9)) {
+            recordPath = argv[i] + 9;
+        } else if (!strncmp(argv[i], "--hashlog=", 10)) {
+            hashLogPath = argv[i] + 10;
+        }
+    }
+    testui(turbo, speed, recordPath, hashLogPath);
     return 1;
 
     Memory memory;          // Initialize memory with default size (64k)
@@ -228,7 +306,7 @@ int main(int argc, char **argv) {
     uint16_t offset = 0;
     if (argc > 1) {
         printf("Loading PRG: %s\n", argv[1]);
-        offset = LoadPRG(argv[1], cpu);
+        offset = Loader::LoadPRG(memory, argv[1]);
         if (!offset) {
             printf("Err: Unable to load %s\n", argv[1]);
             return 0;
@@ -248,5 +326,9 @@ int main(int argc, char **argv) {
         HexDump(memory.RawPtr(), 0x4100, 16);
     }
     HexDump(memory.RawPtr(), 0x4100, 16);
+#ifdef EMU6502_HEATMAP
+    memory.AccessStats().ExportPNG("heatmap.png");
+    memory.AccessStats().ExportCSV("heatmap_exec.csv", AccessCounters::Kind::Execute);
+#endif
     return 0;
 }
@@ -7,61 +7,184 @@
 
 #include "memory.h"
 
-Memory::Memory(size_t szRam /*= EMU6502_RAM_SIZE*/) : szRamBuffer(szRam) {
-    ram = new uint8_t[szRam];
+// Sizes in pages
+#define BASIC_ROM_PAGES     32
+#define KERNAL_ROM_PAGES    32
+#define CHARGEN_ROM_PAGES   16
+
+// Processor port default values after reset (all bits but CASSETTE SENSE are outputs, BASIC/KERNAL/IO visible)
+#define DEFAULT_PORT_DDR    0x2f
+#define DEFAULT_PORT_DATA   0x37
+
+Memory::Memory(size_t szRam /*= EMU6502_RAM_SIZE*/) : szRamBuffer(szRam), ownsRam(true) {
+    // Note: only the first 64k are addressable, the guard is placed right after
+    ram = new uint8_t[BufferSize(szRam)]();
+    Initialize();
+}
+
+Memory::Memory(uint8_t *ptrRamBuffer, size_t szRam) : szRamBuffer(szRam), ram(ptrRamBuffer), ownsRam(false) {
+    assert(ram != nullptr);
+    memset(ram, 0, BufferSize(szRam));
+    Initialize();
 }
 
 Memory::~Memory() {
-    delete ram;
+    if (ownsRam) {
+        delete[] ram;
+    }
+}
+
+void Memory::Initialize() {
+    assert(szRamBuffer >= kPageSize * kNumPages);
+    ram[ProcessorPortDDR] = DEFAULT_PORT_DDR;
+    ram[ProcessorPortData] = DEFAULT_PORT_DATA;
+
+    MapRAM(0, kNumPages);
+    OnLowRAMWrite(ProcessorPortData);
 }
 
 void Memory::CopyTo(uint32_t dstIndex, const void *src, size_t nBytes) {
     assert(ram != nullptr);
-    assert((dstIndex + nBytes) < szRamBuffer);
+    assert((dstIndex + nBytes) <= szRamBuffer);
     memcpy(&ram[dstIndex], src, nBytes);
+    if (nBytes > 0) {
+        for(uint32_t idxPage = dstIndex >> 8; idxPage <= ((dstIndex + nBytes - 1) >> 8); idxPage++) {
+            MarkPageDirty(idxPage);
+        }
+    }
+    // Loading over the processor port must rebank..
+    if (dstIndex < kGuardSize) {
+        OnLowRAMWrite(dstIndex);
+    }
 }
 
+// Keeps the guard region in sync and rebanks if the processor port was written
+void Memory::OnLowRAMWrite(uint32_t index) {
+    memcpy(&ram[kAddressMask + 1], &ram[0], kGuardSize);
+    if ((index & kAddressMask) <= ProcessorPortData) {
+        UpdateBanking();
+    }
+}
 
-uint8_t Memory::ReadU8(uint32_t index) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    return ram[index];
+//
+// Dirty page tracking
+//
+size_t Memory::NumDirtyPages() const {
+    size_t count = 0;
+    for(size_t i=0;i<kNumDirtyWords;i++) {
+        count += std::popcount(dirtyPages[i]);
+    }
+    return count;
 }
 
-uint16_t Memory::ReadU16(uint32_t index) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    auto p16 = reinterpret_cast<uint16_t *>(&ram[index]);
-    return *p16;
+void Memory::ClearDirtyPages() {
+    memset(dirtyPages, 0, sizeof(dirtyPages));
+}
 
+//
+// Page table
+//
+void Memory::MapRAM(uint8_t firstPage, size_t nPages) {
+    assert((firstPage + nPages) <= kNumPages);
+    for(size_t i=0;i<nPages;i++) {
+        auto ptrPage = &ram[(firstPage + i) * kPageSize];
+        pages[firstPage + i] = { ptrPage, ptrPage, nullptr };
+        pageFlags[firstPage + i] = kPageReadRAM | kPageWriteRAM;
+    }
 }
 
-uint32_t Memory::ReadU32(uint32_t index) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    auto p32 = reinterpret_cast<uint32_t *>(&ram[index]);
-    return *p32;
+// Reads from ROM, writes goes to the RAM underneath
+void Memory::MapROM(uint8_t firstPage, size_t nPages, const uint8_t *rom) {
+    assert((firstPage + nPages) <= kNumPages);
+    assert(rom != nullptr);
+    for(size_t i=0;i<nPages;i++) {
+        pages[firstPage + i] = { &rom[i * kPageSize], &ram[(firstPage + i) * kPageSize], nullptr };
+        pageFlags[firstPage + i] = kPageWriteRAM;
+    }
 }
 
-void Memory::WriteU8(uint32_t index, uint8_t value) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    ram[index] = value;
+void Memory::MapIO(uint8_t firstPage, size_t nPages, MemoryMappedIO *device) {
+    assert((firstPage + nPages) <= kNumPages);
+    assert(device != nullptr);
+    for(size_t i=0;i<nPages;i++) {
+        pages[firstPage + i] = { nullptr, nullptr, device };
+        pageFlags[firstPage + i] = 0;
+    }
 }
 
-void Memory::WriteU16(uint32_t index, uint16_t value) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    auto p16 = reinterpret_cast<uint16_t *>(&ram[index]);
-    *p16 = value;
+// Colour RAM lives outside the RAM buffer, so the pages are never flat
+void Memory::MapColorRAM() {
+    for(size_t i=0;i<(kColorRAMSize / kPageSize);i++) {
+        auto ptrPage = &colorRam[i * kPageSize];
+        pages[kColorRAMFirstPage + i] = { ptrPage, ptrPage, nullptr };
+        pageFlags[kColorRAMFirstPage + i] = 0;
+    }
+}
 
+//
+// C64 Banking
+//
+void Memory::SetROM(Rom rom, const uint8_t *data) {
+    roms[static_cast<size_t>(rom)] = data;
+    UpdateBanking();
 }
 
-void Memory::WriteU32(uint32_t index, uint32_t value) {
-    assert(ram != nullptr);
-    assert(index < szRamBuffer);
-    auto p32 = reinterpret_cast<uint32_t *>(&ram[index]);
-    *p32 = value;
+// Attach a device to the I/O area ($d000 - $dfff), it is visible when the processor port banks in I/O
+void Memory::AttachIO(uint8_t firstPage, size_t nPages, MemoryMappedIO *device) {
+    assert(firstPage >= kIOFirstPage);
+    assert((firstPage + nPages) <= (kIOFirstPage + kIONumPages));
+    for(size_t i=0;i<nPages;i++) {
+        ioDevices[firstPage - kIOFirstPage + i] = device;
+    }
+    UpdateBanking();
 }
 
+// Called whenever $00/$01 is written to
+void Memory::UpdateBanking() {
+    uint8_t ddr = ram[ProcessorPortDDR];
+    // Lines configured as input are pulled high
+    uint8_t port = (ram[ProcessorPortData] & ddr) | (~ddr);
+
+    bool loram = (port & kPortLORAM);
+    bool hiram = (port & kPortHIRAM);
+    bool charen = (port & kPortCHAREN);
+
+    auto basic = roms[static_cast<size_t>(Rom::Basic)];
+    auto kernal = roms[static_cast<size_t>(Rom::Kernal)];
+    auto chargen = roms[static_cast<size_t>(Rom::CharGen)];
 
+    // $a000 - $bfff
+    if (loram && hiram && (basic != nullptr)) {
+        MapROM(0xa0, BASIC_ROM_PAGES, basic);
+    } else {
+        MapRAM(0xa0, BASIC_ROM_PAGES);
+    }
+
+    // $e000 - $ffff
+    if (hiram && (kernal != nullptr)) {
+        MapROM(0xe0, KERNAL_ROM_PAGES, kernal);
+    } else {
+        MapRAM(0xe0, KERNAL_ROM_PAGES);
+    }
+
+    // $d000 - $dfff, pages without a device are left as RAM
+    MapRAM(kIOFirstPage, kIONumPages);
+    if (!loram && !hiram) {
+        return;
+    }
+    if (charen) {
+        bool hasDevices = false;
+        for(size_t i=0;i<kIONumPages;i++) {
+            if (ioDevices[i] != nullptr) {
+                MapIO(kIOFirstPage + i, 1, ioDevices[i]);
+                hasDevices = true;
+            }
+        }
+        // Colour RAM comes with the I/O chips, plain 64k RAM setups keep $d800 as RAM
+        if (hasDevices) {
+            MapColorRAM();
+        }
+    } else if (chargen != nullptr) {
+        MapROM(kIOFirstPage, CHARGEN_ROM_PAGES, chargen);
+    }
+}
@@ -5,33 +5,274 @@
 #ifndef EMU6502_MEMORY_H
 #define EMU6502_MEMORY_H
 
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <bit>
+
+#include "memstats.h"
+
 #ifndef EMU6502_RAM_SIZE
 #define EMU6502_RAM_SIZE 65536
 #endif
 
+//
+// Interface for chips mapped in to the address space (VIC, SID, CIA, etc..)
+// The address is the full 16 bit CPU address - the device must handle mirroring itself
+//
+class MemoryMappedIO {
+public:
+    virtual ~MemoryMappedIO() = default;
+    virtual uint8_t ReadIO(uint16_t address) = 0;
+    virtual void WriteIO(uint16_t address, uint8_t value) = 0;
+};
+
+//
+// 64k address space split in 256 pages, each page points to RAM, ROM or an I/O device
+// Reads/Writes to RAM pages are a single indexed load/store - everything else goes through the device
+//
+// The C64 processor port ($00/$01) is emulated here, writing to it will rebank BASIC/KERNAL/CHARGEN/IO.
+// ROM's and I/O devices are only banked in if they have been attached, without any of them the memory
+// behaves like plain 64k RAM (which is what the CPU-only path in main expects).
+//
+// Multi-byte access wraps $ffff -> $0000. The RAM buffer has a guard region after $ffff which mirrors the
+// first bytes of RAM, this way a 16/32 bit read spanning two RAM pages is still a single unaligned load.
+// Zeropage and 'JMP ($xxff)' wrapping are handled by ReadU16ZeroPage/ReadU16PageWrap.
+// NOTE: Multi-byte values are little endian, assumes a little endian host.
+//
+// Colour RAM (1k nibbles at $d800 - $dbff) is a separate buffer, it is mapped in together with the I/O area
+// (once a device is attached) and is always visible to the VIC through ColorRAM(). Only the low nibble is used.
+//
+// Every write to RAM marks the page as dirty, use ForEachDirtyPage/ClearDirtyPages to find what changed since
+// the last checkpoint (snapshots, memory views, state hashing). Raw writes through operator[]/PtrAt are not tracked.
+//
+// see: https://www.c64-wiki.com/wiki/Bank_Switching
+//
 class Memory {
+public:
+    enum class Rom : uint8_t {
+        Basic = 0,
+        Kernal = 1,
+        CharGen = 2,
+    };
+    // Processor port
+    static const uint16_t ProcessorPortDDR = 0x00;
+    static const uint16_t ProcessorPortData = 0x01;
+    static const uint8_t kPortLORAM = 0x01;
+    static const uint8_t kPortHIRAM = 0x02;
+    static const uint8_t kPortCHAREN = 0x04;
+
+    static const size_t kPageSize = 256;
+    static const size_t kNumPages = 256;
+    static const size_t kColorRAMSize = 1024;
 public:
     Memory(size_t szRam = EMU6502_RAM_SIZE);
+    // Use an external RAM buffer (e.g. from an arena), must be at least BufferSize(szRam) bytes - not owned
+    Memory(uint8_t *ptrRamBuffer, size_t szRam);
     ~Memory();
+    Memory(const Memory &) = delete;
+    Memory &operator=(const Memory &) = delete;
+
+    static constexpr size_t BufferSize(size_t szRam = EMU6502_RAM_SIZE) { return szRam + kGuardSize; }
 
     void CopyTo(uint32_t dstIndex, const void *src, size_t nBytes);
+    // Raw access to RAM, bypasses the page table
     const uint8_t *RawPtr() { return ram; }
     uint8_t *PtrAt(uint32_t index) { return &ram[index]; }
-    uint8_t ReadU8(uint32_t index);
-    uint16_t ReadU16(uint32_t index);
-    uint32_t ReadU32(uint32_t index);
-    void WriteU8(uint32_t index, uint8_t value);
-    void WriteU16(uint32_t index, uint16_t value);
-    void WriteU32(uint32_t index, uint32_t value);
+    const uint8_t *ColorRAM() const { return colorRam; }
+
+    inline uint8_t ReadU8(uint32_t index) {
+        accessStats.OnRead(index);
+        auto &page = pages[(index >> 8) & 0xff];
+        if (page.read != nullptr) {
+            return page.read[index & 0xff];
+        }
+        return page.device->ReadIO(index & 0xffff);
+    }
+    inline uint16_t ReadU16(uint32_t index) {
+        index &= kAddressMask;
+        if (IsFlatRead(index)) {
+            uint16_t value;
+            memcpy(&value, &ram[index], sizeof(value));
+            OnFlatAccess(index, sizeof(value), false);
+            return value;
+        }
+        return ReadU8(index) | (ReadU8((index + 1) & kAddressMask) << 8);
+    }
+    inline uint32_t ReadU32(uint32_t index) {
+        index &= kAddressMask;
+        if (IsFlatRead(index)) {
+            uint32_t value;
+            memcpy(&value, &ram[index], sizeof(value));
+            OnFlatAccess(index, sizeof(value), false);
+            return value;
+        }
+        return ReadU16(index) | (ReadU16((index + 2) & kAddressMask) << 16);
+    }
+    // Reads a pointer from zeropage, ($ff) takes the high byte from $00
+    inline uint16_t ReadU16ZeroPage(uint8_t index) {
+        accessStats.OnRead(index);
+        accessStats.OnRead((index + 1) & 0xff);
+        if (index != 0xff) {
+            uint16_t value;
+            memcpy(&value, &ram[index], sizeof(value));
+            return value;
+        }
+        return ram[0xff] | (ram[0x00] << 8);
+    }
+    // Reads a pointer without crossing the page, this is the 'JMP ($xxff)' bug
+    inline uint16_t ReadU16PageWrap(uint32_t index) {
+        index &= kAddressMask;
+        if ((index & 0xff) != 0xff) {
+            return ReadU16(index);
+        }
+        return ReadU8(index) | (ReadU8(index & 0xff00) << 8);
+    }
 
+    inline void WriteU8(uint32_t index, uint8_t value) {
+        accessStats.OnWrite(index);
+        auto &page = pages[(index >> 8) & 0xff];
+        if (page.write != nullptr) {
+            page.write[index & 0xff] = value;
+            MarkPageDirty(index >> 8);
+            if ((index & kAddressMask) < kGuardSize) [[unlikely]] {
+                OnLowRAMWrite(index);
+            }
+            return;
+        }
+        page.device->WriteIO(index & 0xffff, value);
+    }
+    inline void WriteU16(uint32_t index, uint16_t value) {
+        index &= kAddressMask;
+        if (IsFlatWrite(index, sizeof(value))) {
+            memcpy(&ram[index], &value, sizeof(value));
+            MarkPageDirty(index >> 8);
+            MarkPageDirty((index + sizeof(value) - 1) >> 8);
+            OnFlatAccess(index, sizeof(value), true);
+            return;
+        }
+        WriteU8(index, value & 0xff);
+        WriteU8((index + 1) & kAddressMask, value >> 8);
+    }
+    inline void WriteU32(uint32_t index, uint32_t value) {
+        index &= kAddressMask;
+        if (IsFlatWrite(index, sizeof(value))) {
+            memcpy(&ram[index], &value, sizeof(value));
+            MarkPageDirty(index >> 8);
+            MarkPageDirty((index + sizeof(value) - 1) >> 8);
+            OnFlatAccess(index, sizeof(value), true);
+            return;
+        }
+        WriteU16(index, value & 0xffff);
+        WriteU16((index + 2) & kAddressMask, value >> 16);
+    }
+
+    // Page table
+    void MapRAM(uint8_t firstPage, size_t nPages);
+    void MapROM(uint8_t firstPage, size_t nPages, const uint8_t *rom);
+    void MapIO(uint8_t firstPage, size_t nPages, MemoryMappedIO *device);
+    void MapColorRAM();
+
+    // C64 banking
+    void SetROM(Rom rom, const uint8_t *data);
+    const uint8_t *GetROM(Rom rom) const { return roms[static_cast<size_t>(rom)]; }
+    void AttachIO(uint8_t firstPage, size_t nPages, MemoryMappedIO *device);
+    void UpdateBanking();
+
+    // Dirty page tracking
+    inline bool IsPageDirty(uint8_t idxPage) const {
+        return (dirtyPages[idxPage >> 6] >> (idxPage & 63)) & 1;
+    }
+    size_t NumDirtyPages() const;
+    void ClearDirtyPages();
+    // Calls 'fn(uint8_t idxPage)' for each dirty page in ascending order
+    template<typename F>
+    void ForEachDirtyPage(F fn) const {
+        for(size_t i=0;i<kNumDirtyWords;i++) {
+            auto bits = dirtyPages[i];
+            while(bits) {
+                auto idxBit = std::countr_zero(bits);
+                fn(static_cast<uint8_t>(i * 64 + idxBit));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    // Access counters, see memstats.h - compiled out unless EMU6502_HEATMAP is defined
+    MemoryAccessPolicy &AccessStats() { return accessStats; }
+
+    // Raw RAM access, bypasses the page table - this is what the VIC sees and what the debugger should use
     inline uint8_t &operator[](const size_t index) noexcept {
         return ram[index];
     }
 
     // TODO: Support debug flags...
+private:
+    struct Page {
+        const uint8_t *read;        // nullptr - reads are routed to the device
+        uint8_t *write;             // nullptr - writes are routed to the device
+        MemoryMappedIO *device;
+    };
+
+    // Per page flags, set when reads/writes go straight to the RAM buffer
+    static const uint8_t kPageReadRAM = 0x01;
+    static const uint8_t kPageWriteRAM = 0x02;
+
+    // I/O area is $d000 - $dfff
+    static const uint8_t kIOFirstPage = 0xd0;
+    static const size_t kIONumPages = 16;
+    static const uint8_t kColorRAMFirstPage = 0xd8;
+
+    static const uint32_t kAddressMask = 0xffff;
+    // Bytes after $ffff mirroring $0000.., must cover the largest access (32 bit) minus one
+    static const uint32_t kGuardSize = 4;
+
+    static const size_t kNumDirtyWords = kNumPages / 64;
+private:
+    // Reads of up to 4 bytes never span more than two pages
+    inline bool IsFlatRead(uint32_t index) const {
+        auto idxPage = index >> 8;
+        return (pageFlags[idxPage] & pageFlags[(idxPage + 1) & 0xff] & kPageReadRAM);
+    }
+    // Writes must stay clear of the guarded area at both ends, the port and the mirror needs updating
+    inline bool IsFlatWrite(uint32_t index, size_t nBytes) const {
+        if ((index < kGuardSize) || (index > (kAddressMask + 1 - nBytes))) {
+            return false;
+        }
+        auto idxPage = index >> 8;
+        return (pageFlags[idxPage] & pageFlags[(idxPage + 1) & 0xff] & kPageWriteRAM);
+    }
+    void OnLowRAMWrite(uint32_t index);
+    inline void OnFlatAccess(uint32_t index, size_t nBytes, bool isWrite) {
+        if constexpr (MemoryAccessPolicy::kEnabled) {
+            for(size_t i=0;i<nBytes;i++) {
+                if (isWrite) {
+                    accessStats.OnWrite(index + i);
+                } else {
+                    accessStats.OnRead(index + i);
+                }
+            }
+        }
+    }
+    inline void MarkPageDirty(uint32_t idxPage) {
+        idxPage &= 0xff;
+        dirtyPages[idxPage >> 6] |= (uint64_t(1) << (idxPage & 63));
+    }
+private:
+    void Initialize();
 private:
     size_t szRamBuffer;
     uint8_t *ram;
+    bool ownsRam;
+    Page pages[kNumPages];
+    uint8_t pageFlags[kNumPages];
+    uint64_t dirtyPages[kNumDirtyWords] = {0};
+    [[no_unique_address]] MemoryAccessPolicy accessStats;
+
+    uint8_t colorRam[kColorRAMSize] = {0};
+
+    const uint8_t *roms[3] = {nullptr, nullptr, nullptr};
+    MemoryMappedIO *ioDevices[kIONumPages] = {nullptr};
 };
 
 #endif //EMU6502_MEMORY_H
@@ -0,0 +1,87 @@
+//
+// Memory access instrumentation policies
+//
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "memstats.h"
+#include "pngwriter.h"
+
+#define ADDRESS_SPACE_SIZE  65536
+#define HEATMAP_SIZE        256
+
+AccessCounters::AccessCounters() :
+    reads(ADDRESS_SPACE_SIZE, 0),
+    writes(ADDRESS_SPACE_SIZE, 0),
+    executes(ADDRESS_SPACE_SIZE, 0) {
+}
+
+void AccessCounters::Reset() {
+    std::fill(reads.begin(), reads.end(), 0);
+    std::fill(writes.begin(), writes.end(), 0);
+    std::fill(executes.begin(), executes.end(), 0);
+}
+
+uint32_t AccessCounters::Count(Kind kind, uint16_t address) const {
+    switch(kind) {
+        case Kind::Read :
+            return reads[address];
+        case Kind::Write :
+            return writes[address];
+        case Kind::Execute :
+            return executes[address];
+    }
+    return 0;
+}
+
+bool AccessCounters::ExportCSV(const std::string &filename, Kind kind) const {
+    auto f = fopen(filename.c_str(), "w");
+    if (!f) {
+        printf("ERR: Unable to open file: %s\n", filename.c_str());
+        return false;
+    }
+    // Header is the low byte of the address, first column is the page
+    fprintf(f, "page");
+    for(int x=0;x<HEATMAP_SIZE;x++) {
+        fprintf(f, ",%02x", x);
+    }
+    fprintf(f, "\n");
+    for(int y=0;y<HEATMAP_SIZE;y++) {
+        fprintf(f, "%02x", y);
+        for(int x=0;x<HEATMAP_SIZE;x++) {
+            fprintf(f, ",%u", Count(kind, y * HEATMAP_SIZE + x));
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+// Log scale against the max value so a few very hot addresses don't hide everything else
+static uint8_t ToIntensity(uint32_t count, double logMax) {
+    if ((count == 0) || (logMax <= 0.0)) {
+        return 0;
+    }
+    auto v = 32.0 + 223.0 * (std::log((double)count + 1.0) / logMax);
+    return static_cast<uint8_t>(std::min(v, 255.0));
+}
+
+bool AccessCounters::ExportPNG(const std::string &filename) const {
+    auto logMax = [](const std::vector<uint32_t> &counters) {
+        auto maxCount = *std::max_element(counters.begin(), counters.end());
+        return std::log((double)maxCount + 1.0);
+    };
+    auto logMaxReads = logMax(reads);
+    auto logMaxWrites = logMax(writes);
+    auto logMaxExecutes = logMax(executes);
+
+    std::vector<uint8_t> image(ADDRESS_SPACE_SIZE * 4);
+    for(size_t i=0;i<ADDRESS_SPACE_SIZE;i++) {
+        image[i * 4 + 0] = ToIntensity(writes[i], logMaxWrites);
+        image[i * 4 + 1] = ToIntensity(reads[i], logMaxReads);
+        image[i * 4 + 2] = ToIntensity(executes[i], logMaxExecutes);
+        image[i * 4 + 3] = 255;
+    }
+    return PNGWriter::WriteRGBA(filename, image.data(), HEATMAP_SIZE, HEATMAP_SIZE);
+}
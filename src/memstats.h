@@ -0,0 +1,64 @@
+//
+// Memory access instrumentation policies
+//
+
+#ifndef EMU6502_MEMSTATS_H
+#define EMU6502_MEMSTATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//
+// Default policy, everything inlines to nothing
+//
+class NoAccessCounters {
+public:
+    static constexpr bool kEnabled = false;
+
+    inline void OnRead(uint32_t index) {}
+    inline void OnWrite(uint32_t index) {}
+    inline void OnExecute(uint32_t index) {}
+};
+
+//
+// Per address read/write/execute counters for the 64k address space, enable with EMU6502_HEATMAP.
+// The heatmap is 256x256, one row per page. Used to find hot zeropage variables and self modifying code.
+//
+class AccessCounters {
+public:
+    static constexpr bool kEnabled = true;
+
+    enum class Kind : uint8_t {
+        Read = 0,
+        Write = 1,
+        Execute = 2,
+    };
+public:
+    AccessCounters();
+
+    inline void OnRead(uint32_t index) { reads[index & 0xffff]++; }
+    inline void OnWrite(uint32_t index) { writes[index & 0xffff]++; }
+    inline void OnExecute(uint32_t index) { executes[index & 0xffff]++; }
+
+    void Reset();
+    uint32_t Count(Kind kind, uint16_t address) const;
+
+    // 256x256 grid of counters, one line per page
+    bool ExportCSV(const std::string &filename, Kind kind) const;
+    // Log scaled heatmap, red = writes, green = reads, blue = executes
+    bool ExportPNG(const std::string &filename) const;
+private:
+    std::vector<uint32_t> reads;
+    std::vector<uint32_t> writes;
+    std::vector<uint32_t> executes;
+};
+
+#ifdef EMU6502_HEATMAP
+using MemoryAccessPolicy = AccessCounters;
+#else
+using MemoryAccessPolicy = NoAccessCounters;
+#endif
+
+#endif //EMU6502_MEMSTATS_H
@@ -0,0 +1,93 @@
+//
+// Real time pacing of the emulation thread, independent of the UI frame rate
+//
+#include <thread>
+
+#include "pacer.h"
+
+// Sleep granularity is poor on some hosts (~15ms on Windows), the last part is spent yielding instead
+#define SPIN_MARGIN         std::chrono::milliseconds(2)
+// Falling further behind than this drops the debt
+#define MAX_LAG_FRAMES      4
+#define MEASURE_INTERVAL    std::chrono::milliseconds(500)
+
+FramePacer::FramePacer(double framesPerSecond) :
+    frameRate(framesPerSecond),
+    speed(1.0),
+    turbo(false),
+    settingsChanged(0),
+    settingsSeen(0),
+    period(Clock::duration::zero()),
+    measureFrames(0),
+    nFrames(0),
+    nResyncs(0),
+    measuredFrameRate(0.0) {
+
+    Reset();
+}
+
+void FramePacer::SetFrameRate(double framesPerSecond) {
+    frameRate.store(framesPerSecond, std::memory_order_relaxed);
+    settingsChanged.fetch_add(1, std::memory_order_release);
+}
+
+void FramePacer::SetTurbo(bool enable) {
+    turbo.store(enable, std::memory_order_relaxed);
+    settingsChanged.fetch_add(1, std::memory_order_release);
+}
+
+void FramePacer::SetSpeed(double multiplier) {
+    if (multiplier <= 0.0) {
+        return;
+    }
+    speed.store(multiplier, std::memory_order_relaxed);
+    settingsChanged.fetch_add(1, std::memory_order_release);
+}
+
+void FramePacer::Reset() {
+    settingsSeen = settingsChanged.load(std::memory_order_acquire);
+    auto seconds = 1.0 / (frameRate.load(std::memory_order_relaxed) * speed.load(std::memory_order_relaxed));
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    deadline = Clock::now() + period;
+}
+
+void FramePacer::WaitForNextFrame() {
+    nFrames.fetch_add(1, std::memory_order_relaxed);
+    if (settingsChanged.load(std::memory_order_acquire) != settingsSeen) {
+        Reset();
+    }
+    if (turbo.load(std::memory_order_relaxed)) {
+        UpdateMeasurement(Clock::now());
+        return;
+    }
+
+    auto now = Clock::now();
+    if (now - deadline > period * MAX_LAG_FRAMES) {
+        // Host is too slow (or was suspended), continue from here at the normal rate
+        deadline = now;
+        nResyncs.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (deadline - now > SPIN_MARGIN) {
+        std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+    }
+    while(Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    UpdateMeasurement(deadline);
+    deadline += period;
+}
+
+void FramePacer::UpdateMeasurement(Clock::time_point now) {
+    measureFrames++;
+    auto elapsed = now - measureStart;
+    if (elapsed < MEASURE_INTERVAL) {
+        return;
+    }
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    // The first interval starts from the epoch of the clock, skip it
+    if (measureStart != Clock::time_point()) {
+        measuredFrameRate.store(double(measureFrames) / seconds, std::memory_order_relaxed);
+    }
+    measureStart = now;
+    measureFrames = 0;
+}
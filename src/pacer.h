@@ -0,0 +1,63 @@
+//
+// Real time pacing of the emulation thread, independent of the UI frame rate
+//
+
+#ifndef EMU6502_PACER_H
+#define EMU6502_PACER_H
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+
+//
+// Frames are scheduled on an absolute timeline (deadline += period) so sleep jitter never accumulates.
+// When the host falls behind by more than a few frames the debt is dropped instead of catching up in a burst.
+// Turbo and speed can be changed from any thread, the emulation thread picks them up on the next frame.
+//
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+public:
+    explicit FramePacer(double framesPerSecond);
+
+    // Emulation thread, call once per emulated frame - returns when the next frame is due
+    void WaitForNextFrame();
+    // Restart the timeline from now, e.g. after a pause
+    void Reset();
+
+    // e.g. VIC::kModel.FrameRate()
+    void SetFrameRate(double framesPerSecond);
+    double FrameRate() const { return frameRate.load(std::memory_order_relaxed); }
+    // Unthrottled, frames are emitted as fast as the host can run them
+    void SetTurbo(bool enable);
+    bool Turbo() const { return turbo.load(std::memory_order_relaxed); }
+    // Multiplier of the real time speed, 0.5 - half speed, 2.0 - double speed
+    void SetSpeed(double multiplier);
+    double Speed() const { return speed.load(std::memory_order_relaxed); }
+
+    uint64_t Frames() const { return nFrames.load(std::memory_order_relaxed); }
+    // Emulated frames per host second, averaged over roughly half a second
+    double MeasuredFrameRate() const { return measuredFrameRate.load(std::memory_order_relaxed); }
+    // Number of times the timeline was resynchronized because the host couldn't keep up
+    uint64_t Resyncs() const { return nResyncs.load(std::memory_order_relaxed); }
+private:
+    void UpdateMeasurement(Clock::time_point now);
+private:
+    std::atomic<double> frameRate;
+    std::atomic<double> speed;
+    std::atomic<bool> turbo;
+    std::atomic<uint32_t> settingsChanged;     // bumped by the setters, restarts the timeline
+
+    // Emulation thread only
+    uint32_t settingsSeen;
+    Clock::duration period;
+    Clock::time_point deadline;
+    Clock::time_point measureStart;
+    uint64_t measureFrames;
+
+    std::atomic<uint64_t> nFrames;
+    std::atomic<uint64_t> nResyncs;
+    std::atomic<double> measuredFrameRate;
+};
+
+#endif //EMU6502_PACER_H
@@ -0,0 +1,156 @@
+//
+// Graphics byte to pixel expansion for the VIC renderer, one byte is 8 pixels (one cycle)
+//
+// Pixels are 8 bit palette indices. The span functions expand a run of columns (each with its own colors),
+// 4 columns per step with AVX2 (EMU6502_AVX2 in cmake), 2 with SSE2 and one at a time otherwise.
+// The bits are broadcast to their 8 pixels, 'and' with a per pixel bit selects and 'cmpeq' gives the blend masks.
+//
+
+#ifndef EMU6502_PIXELEXPAND_H
+#define EMU6502_PIXELEXPAND_H
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EMU6502_PIXELEXPAND_SSE2
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EMU6502_PIXELEXPAND_AVX2
+#endif
+
+namespace PixelExpand {
+
+    static const uint64_t kBroadcast = 0x0101010101010101ull;
+    // Per pixel bit selects, byte 0 (leftmost pixel) is the MSB
+    static const uint64_t kHiResSelect = 0x0102040810204080ull;
+    // Multicolor, the upper/lower bit of the pair each pixel belongs to
+    static const uint64_t kMultiColorSelectHi = 0x0202080820208080ull;
+    static const uint64_t kMultiColorSelectLo = 0x0101040410104040ull;
+
+    // Bit -> byte masks (0x00/0xff), MSB is the leftmost pixel (lowest address)
+    struct ExpandTables {
+        uint64_t hiResMasks[256];
+        constexpr ExpandTables() : hiResMasks() {
+            for(int b=0;b<256;b++) {
+                for(int i=0;i<8;i++) {
+                    if (b & (0x80 >> i)) {
+                        hiResMasks[b] |= uint64_t(0xff) << (i * 8);
+                    }
+                }
+            }
+        }
+    };
+    static constexpr ExpandTables kTables{};
+
+    // Hi-res, set bits are 'fg'
+    static inline void HiRes(uint8_t *dst, uint8_t bits, uint8_t fg, uint8_t bg) {
+        auto mask = kTables.hiResMasks[bits];
+        uint64_t pixels = (mask & (fg * kBroadcast)) | (~mask & (bg * kBroadcast));
+        memcpy(dst, &pixels, sizeof(pixels));
+    }
+
+    // Multicolor, each bit pair selects one of 'colors[4]' and is drawn as two pixels
+    static inline void MultiColor(uint8_t *dst, uint8_t bits, const uint8_t colors[4]) {
+        for(int i=0;i<4;i++) {
+            auto col = colors[(bits >> (6 - i * 2)) & 3];
+            dst[i * 2] = col;
+            dst[i * 2 + 1] = col;
+        }
+    }
+
+    static inline void Fill(uint8_t *dst, uint8_t col) {
+        uint64_t pixels = col * kBroadcast;
+        memcpy(dst, &pixels, sizeof(pixels));
+    }
+
+#if defined(EMU6502_PIXELEXPAND_SSE2)
+    // a a a a a a a a b b b b b b b b
+    static inline __m128i Broadcast2(const uint8_t *v) {
+        auto x = _mm_cvtsi32_si128(v[0] | (v[1] << 8));
+        x = _mm_unpacklo_epi8(x, x);
+        x = _mm_unpacklo_epi16(x, x);
+        return _mm_unpacklo_epi32(x, x);
+    }
+    static inline __m128i Select2(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+    static inline __m128i BitMask2(__m128i bits, __m128i select) {
+        return _mm_cmpeq_epi8(_mm_and_si128(bits, select), select);
+    }
+#endif
+
+#if defined(EMU6502_PIXELEXPAND_AVX2)
+    // Column n in 64 bit lane n, the bytes are picked within each 128 bit half from a broadcast
+    static inline __m256i Broadcast4(const uint8_t *v) {
+        uint32_t packed;
+        memcpy(&packed, v, sizeof(packed));
+        static const uint64_t k0 = 0, k1 = kBroadcast, k2 = 2 * kBroadcast, k3 = 3 * kBroadcast;
+        return _mm256_shuffle_epi8(_mm256_set1_epi32(int32_t(packed)), _mm256_setr_epi64x(k0, k1, k2, k3));
+    }
+    static inline __m256i BitMask4(__m256i bits, __m256i select) {
+        return _mm256_cmpeq_epi8(_mm256_and_si256(bits, select), select);
+    }
+#endif
+
+    // 'n' hi-res columns, column i uses bits[i], fg[i] and bg[i]
+    static inline void HiResSpan(uint8_t *dst, const uint8_t *bits, const uint8_t *fg, const uint8_t *bg, uint32_t n) {
+        uint32_t i = 0;
+#if defined(EMU6502_PIXELEXPAND_AVX2)
+        auto select4 = _mm256_set1_epi64x(int64_t(kHiResSelect));
+        for(;i + 4 <= n;i+=4, dst+=32) {
+            auto mask = BitMask4(Broadcast4(&bits[i]), select4);
+            auto pixels = _mm256_blendv_epi8(Broadcast4(&bg[i]), Broadcast4(&fg[i]), mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), pixels);
+        }
+#endif
+#if defined(EMU6502_PIXELEXPAND_SSE2)
+        auto select2 = _mm_set1_epi64x(int64_t(kHiResSelect));
+        for(;i + 2 <= n;i+=2, dst+=16) {
+            auto mask = BitMask2(Broadcast2(&bits[i]), select2);
+            auto pixels = Select2(mask, Broadcast2(&fg[i]), Broadcast2(&bg[i]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), pixels);
+        }
+#endif
+        for(;i<n;i++, dst+=8) {
+            HiRes(dst, bits[i], fg[i], bg[i]);
+        }
+    }
+
+    // 'n' multicolor columns, the bit pairs of bits[i] selects c0[i], c1[i], c2[i] or c3[i]
+    static inline void MultiColorSpan(uint8_t *dst, const uint8_t *bits, const uint8_t *c0, const uint8_t *c1, const uint8_t *c2, const uint8_t *c3, uint32_t n) {
+        uint32_t i = 0;
+#if defined(EMU6502_PIXELEXPAND_AVX2)
+        auto selectHi4 = _mm256_set1_epi64x(int64_t(kMultiColorSelectHi));
+        auto selectLo4 = _mm256_set1_epi64x(int64_t(kMultiColorSelectLo));
+        for(;i + 4 <= n;i+=4, dst+=32) {
+            auto b = Broadcast4(&bits[i]);
+            auto hi = BitMask4(b, selectHi4);
+            auto lo = BitMask4(b, selectLo4);
+            auto low = _mm256_blendv_epi8(Broadcast4(&c0[i]), Broadcast4(&c1[i]), lo);
+            auto high = _mm256_blendv_epi8(Broadcast4(&c2[i]), Broadcast4(&c3[i]), lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_blendv_epi8(low, high, hi));
+        }
+#endif
+#if defined(EMU6502_PIXELEXPAND_SSE2)
+        auto selectHi2 = _mm_set1_epi64x(int64_t(kMultiColorSelectHi));
+        auto selectLo2 = _mm_set1_epi64x(int64_t(kMultiColorSelectLo));
+        for(;i + 2 <= n;i+=2, dst+=16) {
+            auto b = Broadcast2(&bits[i]);
+            auto hi = BitMask2(b, selectHi2);
+            auto lo = BitMask2(b, selectLo2);
+            auto low = Select2(lo, Broadcast2(&c1[i]), Broadcast2(&c0[i]));
+            auto high = Select2(lo, Broadcast2(&c3[i]), Broadcast2(&c2[i]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), Select2(hi, high, low));
+        }
+#endif
+        for(;i<n;i++, dst+=8) {
+            const uint8_t colors[4] = { c0[i], c1[i], c2[i], c3[i] };
+            MultiColor(dst, bits[i], colors);
+        }
+    }
+}
+
+#endif //EMU6502_PIXELEXPAND_H
@@ -0,0 +1,222 @@
+//
+// Minimal PNG encoder, used for heatmaps and screenshots
+//
+// see: https://www.w3.org/TR/PNG/ and https://www.ietf.org/rfc/rfc1951.txt
+//
+#include <cstdio>
+#include <cstring>
+
+#include "pngwriter.h"
+
+// Deflate tables for length codes 257..285 and distance codes 0..29
+static const uint16_t lengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t lengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t distBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t distExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+#define LZ_WINDOW_SIZE  32768
+#define LZ_MIN_MATCH    3
+#define LZ_MAX_MATCH    258
+#define LZ_HASH_BITS    15
+
+//
+// Deflate writes bits LSB first, huffman codes are stored MSB first - hence the reversing
+//
+class BitWriter {
+public:
+    BitWriter(std::vector<uint8_t> &output) : out(output) {}
+    inline void Put(uint32_t value, int nBits) {
+        bits |= value << nBitsUsed;
+        nBitsUsed += nBits;
+        while(nBitsUsed >= 8) {
+            out.push_back(bits & 0xff);
+            bits >>= 8;
+            nBitsUsed -= 8;
+        }
+    }
+    inline void PutCode(uint32_t code, int nBits) {
+        uint32_t reversed = 0;
+        for(int i=0;i<nBits;i++) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        Put(reversed, nBits);
+    }
+    void Flush() {
+        if (nBitsUsed > 0) {
+            out.push_back(bits & 0xff);
+        }
+        bits = 0;
+        nBitsUsed = 0;
+    }
+private:
+    std::vector<uint8_t> &out;
+    uint32_t bits = 0;
+    int nBitsUsed = 0;
+};
+
+// Fixed huffman code for literal/length symbols
+static void PutSymbol(BitWriter &bw, int symbol) {
+    if (symbol < 144) {
+        bw.PutCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        bw.PutCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        bw.PutCode(symbol - 256, 7);
+    } else {
+        bw.PutCode(0xc0 + symbol - 280, 8);
+    }
+}
+
+static void PutMatch(BitWriter &bw, size_t length, size_t distance) {
+    int idxLen = 28;
+    while(lengthBase[idxLen] > length) idxLen--;
+    PutSymbol(bw, 257 + idxLen);
+    bw.Put(length - lengthBase[idxLen], lengthExtra[idxLen]);
+
+    int idxDist = 29;
+    while(distBase[idxDist] > distance) idxDist--;
+    bw.PutCode(idxDist, 5);
+    bw.Put(distance - distBase[idxDist], distExtra[idxDist]);
+}
+
+static inline uint32_t Hash3(const uint8_t *ptr) {
+    uint32_t v = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+void PNGWriter::Deflate(std::vector<uint8_t> &out, const uint8_t *data, size_t len) {
+    BitWriter bw(out);
+    // Single final block with fixed huffman codes
+    bw.Put(1, 1);
+    bw.Put(1, 2);
+
+    std::vector<int32_t> head(1 << LZ_HASH_BITS, -1);
+    size_t i = 0;
+    while(i < len) {
+        size_t bestLen = 0;
+        size_t bestDist = 0;
+        if ((i + LZ_MIN_MATCH) <= len) {
+            auto h = Hash3(&data[i]);
+            int32_t candidate = head[h];
+            head[h] = static_cast<int32_t>(i);
+            if ((candidate >= 0) && ((i - candidate) <= LZ_WINDOW_SIZE)) {
+                size_t maxLen = (len - i) < LZ_MAX_MATCH ? (len - i) : LZ_MAX_MATCH;
+                size_t matchLen = 0;
+                while((matchLen < maxLen) && (data[candidate + matchLen] == data[i + matchLen])) {
+                    matchLen++;
+                }
+                if (matchLen >= LZ_MIN_MATCH) {
+                    bestLen = matchLen;
+                    bestDist = i - candidate;
+                }
+            }
+        }
+        if (bestLen) {
+            PutMatch(bw, bestLen, bestDist);
+            // Keep the hash chain up to date for the skipped positions
+            for(size_t j=i+1;(j < i + bestLen) && ((j + LZ_MIN_MATCH) <= len);j++) {
+                head[Hash3(&data[j])] = static_cast<int32_t>(j);
+            }
+            i += bestLen;
+        } else {
+            PutSymbol(bw, data[i]);
+            i++;
+        }
+    }
+    // End of block
+    PutSymbol(bw, 256);
+    bw.Flush();
+}
+
+uint32_t PNGWriter::CRC32(const uint8_t *data, size_t len, uint32_t crc /* = 0 */) {
+    static uint32_t table[256];
+    static bool tableInitialized = []() {
+        for(uint32_t n=0;n<256;n++) {
+            uint32_t c = n;
+            for(int k=0;k<8;k++) {
+                c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)tableInitialized;
+
+    crc = ~crc;
+    for(size_t i=0;i<len;i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t PNGWriter::Adler32(const uint8_t *data, size_t len) {
+    uint32_t a = 1, b = 0;
+    for(size_t i=0;i<len;i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void PutU32BE(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+void PNGWriter::WriteChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t len) {
+    PutU32BE(out, len);
+    auto ofsType = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + len);
+    PutU32BE(out, CRC32(&out[ofsType], len + 4));
+}
+
+void PNGWriter::EncodeRGBA(std::vector<uint8_t> &out, const void *data, size_t width, size_t height, size_t stride /* = 0 */) {
+    if (stride == 0) {
+        stride = width * 4;
+    }
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.insert(out.end(), signature, signature + sizeof(signature));
+
+    std::vector<uint8_t> header;
+    PutU32BE(header, width);
+    PutU32BE(header, height);
+    header.push_back(8);    // bit depth
+    header.push_back(6);    // color type, RGBA
+    header.push_back(0);    // compression
+    header.push_back(0);    // filter
+    header.push_back(0);    // interlace
+    WriteChunk(out, "IHDR", header.data(), header.size());
+
+    // Each scanline is prefixed by the filter type, we only use 'None'
+    std::vector<uint8_t> raw;
+    raw.reserve((width * 4 + 1) * height);
+    auto src = reinterpret_cast<const uint8_t *>(data);
+    for(size_t y=0;y<height;y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), &src[y * stride], &src[y * stride + width * 4]);
+    }
+
+    // zlib stream, header + deflate + adler32
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    Deflate(zlib, raw.data(), raw.size());
+    PutU32BE(zlib, Adler32(raw.data(), raw.size()));
+    WriteChunk(out, "IDAT", zlib.data(), zlib.size());
+    WriteChunk(out, "IEND", nullptr, 0);
+}
+
+bool PNGWriter::WriteRGBA(const std::string &filename, const void *data, size_t width, size_t height, size_t stride /* = 0 */) {
+    std::vector<uint8_t> png;
+    EncodeRGBA(png, data, width, height, stride);
+
+    auto f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        printf("ERR: Unable to open file: %s\n", filename.c_str());
+        return false;
+    }
+    auto nWritten = fwrite(png.data(), 1, png.size(), f);
+    fclose(f);
+    return (nWritten == png.size());
+}
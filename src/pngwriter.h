@@ -0,0 +1,30 @@
+//
+// Minimal PNG encoder, used for heatmaps and screenshots
+//
+
+#ifndef EMU6502_PNGWRITER_H
+#define EMU6502_PNGWRITER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//
+// Encodes 8 bit RGBA images, the deflate stream uses fixed huffman codes with a simple LZ77 matcher.
+// Not the best compression but emulator output (large flat areas) compresses well enough and it has no dependencies.
+//
+class PNGWriter {
+public:
+    // Stride is in bytes, 0 means width * 4
+    static bool WriteRGBA(const std::string &filename, const void *data, size_t width, size_t height, size_t stride = 0);
+    static void EncodeRGBA(std::vector<uint8_t> &out, const void *data, size_t width, size_t height, size_t stride = 0);
+
+    static uint32_t CRC32(const uint8_t *data, size_t len, uint32_t crc = 0);
+    static uint32_t Adler32(const uint8_t *data, size_t len);
+private:
+    static void Deflate(std::vector<uint8_t> &out, const uint8_t *data, size_t len);
+    static void WriteChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t len);
+};
+
+#endif //EMU6502_PNGWRITER_H
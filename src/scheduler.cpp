@@ -0,0 +1,110 @@
+//
+// Discrete event scheduler, the chips run from event to event instead of being ticked every cycle
+//
+#include <cstdio>
+
+#include "scheduler.h"
+
+Scheduler::EventId Scheduler::Register(Handler handler, void *context) {
+    if (nEvents == kMaxEvents) {
+        printf("ERR: Scheduler, too many events (max %zu)\n", kMaxEvents);
+        return kInvalidEvent;
+    }
+    auto id = static_cast<EventId>(nEvents++);
+    events[id] = {handler, context, kNever, kNotPending};
+    return id;
+}
+
+void Scheduler::Schedule(EventId id, uint64_t cycle) {
+    if (id >= nEvents) {
+        // Register() already reported running out of events
+        if (id != kInvalidEvent) {
+            printf("ERR: Scheduler, invalid event %d\n", id);
+        }
+        return;
+    }
+    if (cycle < burstEnd) {
+        burstEnd = cycle;
+    }
+    auto &event = events[id];
+    if (event.heapIndex == kNotPending) {
+        event.cycle = cycle;
+        Place(nPending++, id);
+        SiftUp(event.heapIndex);
+        return;
+    }
+    auto earlier = cycle < event.cycle;
+    event.cycle = cycle;
+    if (earlier) {
+        SiftUp(event.heapIndex);
+    } else {
+        SiftDown(event.heapIndex);
+    }
+}
+
+void Scheduler::Cancel(EventId id) {
+    if (IsPending(id)) {
+        Remove(events[id].heapIndex);
+    }
+}
+
+void Scheduler::Dispatch() {
+    while(nPending && (events[heap[0]].cycle <= now)) {
+        auto id = heap[0];
+        Remove(0);
+        nDispatched++;
+        // The handler may schedule this or any other event again
+        events[id].handler(events[id].context);
+    }
+}
+
+void Scheduler::Place(size_t idx, EventId id) {
+    heap[idx] = id;
+    events[id].heapIndex = static_cast<uint8_t>(idx);
+}
+
+void Scheduler::Remove(size_t idx) {
+    auto id = heap[idx];
+    events[id].heapIndex = kNotPending;
+    nPending--;
+    if (idx == nPending) {
+        return;
+    }
+    // The last event fills the hole, it may belong either above or below it
+    auto moved = heap[nPending];
+    Place(idx, moved);
+    SiftDown(idx);
+    SiftUp(events[moved].heapIndex);
+}
+
+void Scheduler::SiftUp(size_t idx) {
+    auto id = heap[idx];
+    while(idx > 0) {
+        auto parent = (idx - 1) / 2;
+        if (!Before(id, heap[parent])) {
+            break;
+        }
+        Place(idx, heap[parent]);
+        idx = parent;
+    }
+    Place(idx, id);
+}
+
+void Scheduler::SiftDown(size_t idx) {
+    auto id = heap[idx];
+    while(true) {
+        auto child = idx * 2 + 1;
+        if (child >= nPending) {
+            break;
+        }
+        if ((child + 1 < nPending) && Before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!Before(heap[child], id)) {
+            break;
+        }
+        Place(idx, heap[child]);
+        idx = child;
+    }
+    Place(idx, id);
+}
@@ -0,0 +1,78 @@
+//
+// Discrete event scheduler, the chips run from event to event instead of being ticked every cycle
+//
+
+#ifndef EMU6502_SCHEDULER_H
+#define EMU6502_SCHEDULER_H
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// One clock for the whole machine, in CPU cycles. Each chip registers its events once and (re)schedules them
+// for the next cycle where it has something to do (end of line, BA edge, timer underflow, ...).
+// Between events only the CPU runs, in a burst up to the next event - see CPU::Run().
+//
+// Pending events are kept in a binary min-heap, at most one pending instance per event. Events due in the
+// same cycle fire in registration order, so the chips are dispatched in the same order as they would be ticked.
+//
+class Scheduler {
+public:
+    using Handler = void (*)(void *context);
+    using EventId = uint8_t;
+    static const size_t kMaxEvents = 32;
+    static const uint64_t kNever = UINT64_MAX;
+    // Returned by Register() when all events are taken, Schedule()/Cancel() silently ignore it
+    static const EventId kInvalidEvent = 0xff;
+public:
+    Scheduler() = default;
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // Returns the id used to (re)schedule the event, nothing is pending until Schedule() is called.
+    // kInvalidEvent if there are already kMaxEvents
+    EventId Register(Handler handler, void *context);
+    // Absolute cycle, replaces the pending one if any - cycles in the past fire on the next Dispatch()
+    void Schedule(EventId id, uint64_t cycle);
+    inline void ScheduleIn(EventId id, uint64_t nCycles) { Schedule(id, now + nCycles); }
+    void Cancel(EventId id);
+    inline bool IsPending(EventId id) const { return (id < nEvents) && (events[id].heapIndex != kNotPending); }
+
+    // Runs all events due at or before Now(), including events scheduled for now by the handlers
+    void Dispatch();
+    // kNever when nothing is pending
+    inline uint64_t NextEventCycle() const { return nPending ? events[heap[0]].cycle : kNever; }
+
+    inline uint64_t Now() const { return now; }
+    // The clock is advanced by whoever runs between the events (the CPU)
+    inline uint64_t &Clock() { return now; }
+    // Where the CPU burst running between the events ends, set by the caller before the burst (see CPU::Run()).
+    // Scheduling an event before it moves it back, so an event scheduled by the CPU is not dispatched late
+    inline uint64_t &BurstEnd() { return burstEnd; }
+    uint64_t EventsDispatched() const { return nDispatched; }
+private:
+    static const uint8_t kNotPending = 0xff;
+    struct Event {
+        Handler handler;
+        void *context;
+        uint64_t cycle;
+        uint8_t heapIndex;
+    };
+    inline bool Before(EventId a, EventId b) const {
+        return (events[a].cycle < events[b].cycle) || ((events[a].cycle == events[b].cycle) && (a < b));
+    }
+    void SiftUp(size_t idx);
+    void SiftDown(size_t idx);
+    void Place(size_t idx, EventId id);
+    void Remove(size_t idx);
+private:
+    uint64_t now = 0;
+    uint64_t burstEnd = kNever;
+    Event events[kMaxEvents] = {};
+    EventId heap[kMaxEvents] = {};
+    size_t nEvents = 0;
+    size_t nPending = 0;
+    uint64_t nDispatched = 0;
+};
+
+#endif //EMU6502_SCHEDULER_H
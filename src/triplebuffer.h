@@ -0,0 +1,42 @@
+//
+// Lock free triple buffer index, hands completed buffers from one producer thread to one consumer thread
+//
+
+#ifndef EMU6502_TRIPLEBUFFER_H
+#define EMU6502_TRIPLEBUFFER_H
+
+#include <cstdint>
+#include <atomic>
+
+//
+// Only the indices are managed, the owner keeps three buffers. The producer draws in Back() and the consumer reads
+// Front(), the third (middle) buffer is swapped with either side through a single atomic exchange.
+// The producer never waits, when the consumer is slow the middle buffer is simply replaced by a newer one.
+//
+class TripleBuffer {
+public:
+    // Producer, 'Back()' is complete - hand it over and continue in the previous middle buffer
+    inline void Publish() {
+        back = state.exchange(back | kFresh, std::memory_order_acq_rel) & kIndexMask;
+    }
+    inline uint8_t Back() const { return back; }
+
+    // Consumer, returns true if a newer buffer was published since the last call
+    inline bool Acquire() {
+        if (!(state.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        front = state.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+    inline uint8_t Front() const { return front; }
+private:
+    static const uint8_t kFresh = 0x80;
+    static const uint8_t kIndexMask = 0x03;
+
+    uint8_t back = 0;
+    alignas(64) std::atomic<uint8_t> state = 1;     // middle buffer index | kFresh
+    alignas(64) uint8_t front = 2;
+};
+
+#endif //EMU6502_TRIPLEBUFFER_H
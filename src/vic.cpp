@@ -3,19 +3,38 @@
 //
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <memory>
 #include <stdint.h>
 #include "vic.h"
+#include "pixelexpand.h"
 
-#define DEFAULT_TEXT_MODE_ADDR 0x0400
+// Cycle of the first character in the main display area
+#define FIRST_COLUMN_CYCLE      (model.firstColumnCycle)
 
-static VicType vic6569 = {
-        .nVerticalLines = 312,
-        .vblBegin = 300,
-        .vblEnd = 15,
-};
+#define NUM_COLUMNS             40
+
+#define SPRITE_POINTERS_OFFSET  0x3f8
+
+// In pixels from the start of the line, HBL is outside [BORDER_FIRST_X, BORDER_LAST_X)
+#define BORDER_FIRST_X          (model.hblEndCycle * 8)
+#define BORDER_LAST_X           (model.hblBeginCycle * 8)
+#define MAIN_FIRST_X            (FIRST_COLUMN_CYCLE * 8)
+#define SPRITE_X_TO_LINE        (MAIN_FIRST_X - 24)
+
+// The idle state g-access always reads from the last byte of the bank
+#define IDLE_GFX_ADDR           0x3fff
+#define IDLE_GFX_ADDR_ECM       0x39ff
+
+// Bad line DMA, in cycles (0 based) - BA goes low 3 cycles before the c-accesses
+#define BADLINE_BA_START        11
+#define BADLINE_DMA_START       14
+#define BADLINE_DMA_END         54
 
 // Based off PEPTO-PAL from Vice 3.5
-static RGBA palette[]={
+static const RGBA palette[16]={
         // 0:Black
         {0,0,0, 255},
         // 1:White
@@ -52,27 +71,250 @@ static RGBA palette[]={
 };
 
 
-VIC::VIC(Memory &memory) :
+template<const VICModel &model>
+VICII<model>::VICII(Memory &memory, VICGeometry geometry) : VICII(memory, nullptr, geometry) {
+
+}
+
+template<const VICModel &model>
+VICII<model>::VICII(Memory &memory, void *ptrScreenBuffer, VICGeometry geometry) :
     ram(memory),
-    // width 512 is too wide...  probably around 403
-    screen(512,312),
+    window(Window(geometry)),
+    cropLine(window.width != kScreenWidth),
+    windowFirstCycle(window.x / 8),
+    windowLastCycle((window.x + window.width + 7) / 8),
+    frameEndLine((window.y + window.height) % model.nVerticalLines),
+    frame(nullptr),
+    completedFrame(nullptr),
+    ownsFrame(ptrScreenBuffer == nullptr),
+    nFramesConverted(0),
+    renderInterval(1),
+    renderFrame(true),
+    frameRequested(false),
+    nFrames(0),
+    nFramesRendered(0),
+    nRegEvents(0),
+    lineRenderedCycle(0),
     rasterY(0),
     rasterX(0),
+    rasterCompare(0),
     rasterYState(InsideVBL),
-    rasterXState(InsideHBL),
-    videoMatrixAddress(DEFAULT_TEXT_MODE_ADDR),
+    bankAddress(0),
+    displayState(false),
+    videoMatrixBase(0),
     videoMatrixCounter(0),
-    cpuStunned(false)
+    bus(nullptr),
+    scheduler(nullptr),
+    lineStartCycle(0),
+    evLine(0),
+    evBA(0),
+    evBadLineDMA(0),
+    denLatched(false),
+    badLine(false),
+    lineHasDMA(false),
+    spriteDMA(0),
+    spriteFetched(0),
+    videoRowCounter(0)
 {
+    memset(regs, 0, sizeof(regs));
     // Reset some vars
-    ram[BorderCol] = LightBlue;
-    ram[BackgroundCol] = Blue;
-    screen.Clear(Pixmap::White);
+    Reg(Control1) = 0x1b;      // Display enabled, 25 rows, YScroll = 3 (same as KERNAL init)
+    Reg(BorderCol) = LightBlue;
+    Reg(BackgroundCol) = Blue;
+    Reg(Control2) = 0xc8;       // 40 columns, no scroll
+    Reg(MemoryPointers) = 0x15; // Screen at $0400, characters at $1000 (CHARGEN)
+    memcpy(lineRegs, regs, sizeof(regs));
+    memset(lineForeground, 0, sizeof(lineForeground));
+    for(auto &sprite : sprites) {
+        sprite = {0, 0, true, 0};
+    }
+    // Three frames in one block, owned or external (ExternalBufferSize())
+    auto szFrame = window.width * window.height;
+    auto block = ownsFrame ? new uint8_t[szFrame * kNumFrameBuffers] : static_cast<uint8_t *>(ptrScreenBuffer);
+    for(size_t i=0;i<kNumFrameBuffers;i++) {
+        frames[i] = block + szFrame * i;
+        memset(frames[i], White, szFrame);
+    }
+    memset(rowHashes, 0, sizeof(rowHashes));
+    frame = frames[frameBuffers.Back()];
+    completedFrame = frame;
+    SelectLineTarget();
+
+    // Registers are visible in $d000 - $d3ff
+    ram.AttachIO(0xd0, 4, this);
+}
+
+template<const VICModel &model>
+VICII<model>::~VICII() {
+    if (ownsFrame) {
+        delete[] frames[0];
+    }
+}
+
+const RGBA *VICBase::Palette() {
+    return palette;
 }
 
-#define NUM_RAS_LINES_PAL 312
+// The RGBA conversion is only done when someone looks at the screen, and only if a frame was completed since
+template<const VICModel &model>
+const Pixmap &VICII<model>::Screen() {
+    if (screen == nullptr) {
+        screen = std::make_unique<Pixmap>(window.width, window.height);
+        nFramesConverted = nFramesRendered - 1;
+    }
+    if (nFramesConverted != nFramesRendered) {
+        screen->FromIndexed(completedFrame, window.width, palette);
+        nFramesConverted = nFramesRendered;
+    }
+    return *screen;
+}
+
+template<const VICModel &model>
+const uint8_t *VICII<model>::AcquireFrame() {
+    frameBuffers.Acquire();
+    return frames[frameBuffers.Front()];
+}
+
+template<const VICModel &model>
+const Pixmap &VICII<model>::PresentedScreen() {
+    bool first = (presented == nullptr);
+    if (first) {
+        presented = std::make_unique<Pixmap>(window.width, window.height);
+        presentedDirty.Resize(window.height);
+    }
+    presentedDirty.Clear();
+    if (!frameBuffers.Acquire() && !first) {
+        return *presented;
+    }
+    auto idxFront = frameBuffers.Front();
+    for(size_t y=0;y<window.height;y++) {
+        if (first || (rowHashes[idxFront][y] != presentedHashes[y])) {
+            presentedHashes[y] = rowHashes[idxFront][y];
+            presentedDirty.Set(y);
+        }
+    }
+    presentedDirty.ForEachSpan([this, idxFront](size_t firstRow, size_t nRows) {
+        presented->FromIndexed(frames[idxFront], window.width, palette, firstRow, nRows);
+    });
+    return *presented;
+}
 
-void VIC::Tick() {
+// 64 bits at a time multiply/rotate hash, only used to detect changed rows between frames
+static inline uint64_t HashRow(const uint8_t *row, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for(;i + sizeof(uint64_t) <= len;i+=sizeof(uint64_t)) {
+        uint64_t v;
+        memcpy(&v, &row[i], sizeof(v));
+        hash = std::rotl((hash ^ v) * 0x9e3779b97f4a7c15ull, 29);
+    }
+    for(;i<len;i++) {
+        hash = (hash ^ row[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template<const VICModel &model>
+uint8_t VICII<model>::ReadIO(uint16_t address) {
+    CatchUp();
+    auto idxReg = address & kRegMask;
+    // Unused registers ($d02f - $d03f) always read $ff
+    if (idxReg >= kNumRegs) {
+        return 0xff;
+    }
+    auto value = regs[idxReg];
+    // Collision registers are cleared when read
+    if ((idxReg == (SpriteSpriteCollision & kRegMask)) || (idxReg == (SpriteBackgroundCollision & kRegMask))) {
+        regs[idxReg] = 0;
+    }
+    // Bit 7 is set when any enabled source is latched, unused bits read 1
+    if (idxReg == (InterruptStatus & kRegMask)) {
+        auto irq = (value & Reg(InterruptEnable) & kIRQSourceMask) ? 0x80 : 0x00;
+        return value | irq | 0x70;
+    }
+    if (idxReg == (InterruptEnable & kRegMask)) {
+        return value | 0xf0;
+    }
+    return value;
+}
+
+template<const VICModel &model>
+void VICII<model>::WriteIO(uint16_t address, uint8_t value) {
+    CatchUp();
+    auto idxReg = address & kRegMask;
+    if (idxReg >= kNumRegs) {
+        return;
+    }
+    switch(idxReg) {
+        case Control1 & kRegMask :
+            // RST8 reads back the raster counter, the written bit is the compare MSB
+            regs[idxReg] = (value & 0x7f) | (regs[idxReg] & 0x80);
+            WriteRasterCompare((rasterCompare & 0xff) | ((value & 0x80) << 1));
+            break;
+        case Raster & kRegMask :
+            WriteRasterCompare((rasterCompare & 0x100) | value);
+            if (scheduler != nullptr) {
+                ScheduleNextSync();
+            }
+            return;
+        case InterruptStatus & kRegMask :
+            // Acknowledge, writing 1 clears the latch bit
+            regs[idxReg] &= ~value & kIRQSourceMask;
+            UpdateIRQ();
+            return;
+        case InterruptEnable & kRegMask :
+            regs[idxReg] = value & kIRQSourceMask;
+            UpdateIRQ();
+            return;
+        default :
+            regs[idxReg] = value;
+            break;
+    }
+    RecordRegEvent(idxReg, value);
+    // Bad lines, raster compare, border size and sprite Y decide which lines can be skipped
+    if ((scheduler != nullptr) && ((idxReg == (Control1 & kRegMask)) || (idxReg == (SpriteEnable & kRegMask)) ||
+                                   ((idxReg < (SpriteXMSB & kRegMask)) && (idxReg & 1)))) {
+        ScheduleNextSync();
+    }
+}
+
+// Changing the compare value to the current line triggers immediately
+template<const VICModel &model>
+void VICII<model>::WriteRasterCompare(uint16_t value) {
+    if (value == rasterCompare) {
+        return;
+    }
+    rasterCompare = value;
+    if (rasterCompare == rasterY) {
+        RaiseIRQ(kIRQRaster);
+    }
+}
+
+template<const VICModel &model>
+void VICII<model>::RaiseIRQ(uint8_t sources) {
+    Reg(InterruptStatus) |= sources;
+    UpdateIRQ();
+}
+
+template<const VICModel &model>
+void VICII<model>::UpdateIRQ() {
+    if (bus != nullptr) {
+        bus->SetIRQ(Bus::kIRQSourceVIC, (Reg(InterruptStatus) & Reg(InterruptEnable)) != 0);
+    }
+}
+
+// The write is seen by the renderer from the next cycle on
+template<const VICModel &model>
+void VICII<model>::RecordRegEvent(uint8_t idxReg, uint8_t value) {
+    if (nRegEvents == kMaxRegEvents) {
+        // More writes than cycles - draw what we have so far and start over
+        RenderLine(rasterX + 1);
+    }
+    regEvents[nRegEvents++] = {static_cast<uint8_t>(rasterX), idxReg, value};
+}
+
+template<const VICModel &model>
+void VICII<model>::Tick() {
 
     if (rasterY == 0x30) {
         // Check DEN in d011 - if not set we should switch off display fully
@@ -80,131 +322,827 @@ void VIC::Tick() {
     }
 
     UpdateHorizontalState();
+    if (rasterX == 0) {
+        StartRasterLine();
+    }
+    // Non bad-lines without sprites have nothing to do here
+    if (lineHasDMA) {
+        HandleDMA();
+    }
+    // Tick CPU here...
+
+}
+
+template<const VICModel &model>
+void VICII<model>::StartRasterLine() {
+    // Draw the line we just finished before moving on
+    EndRasterLine();
     UpdateVerticalState();
+    BeginRasterLine();
+    if (rasterY == rasterCompare) {
+        RaiseIRQ(kIRQRaster);
+    }
+}
 
-    if (IsBadLine()) {
-        HandleBadLine();
+//
+// Scheduled mode, the same work as Tick() but only in the cycles where something happens.
+// The VIC keeps its own position (lineStartCycle) and catches up with the scheduler clock lazily: when the CPU
+// touches a register, at BA edges and bad line DMA, and at the start of lines that must not be skipped
+// (see ScheduleNextSync). The CPU is halted from BADLINE_DMA_START on, so all 40 c-accesses are done at once.
+//
+template<const VICModel &model>
+void VICII<model>::ConnectScheduler(Scheduler *newScheduler) {
+    scheduler = newScheduler;
+    if (scheduler == nullptr) {
+        return;
     }
+    evLine = scheduler->Register(&VICII::OnLineEvent, this);
+    evBA = scheduler->Register(&VICII::OnBAEvent, this);
+    evBadLineDMA = scheduler->Register(&VICII::OnBadLineDMAEvent, this);
 
-    // No need to do any drawing...
-    RenderToScreen();
-    // Tick CPU here...
+    // The next Tick() would have been rasterX + 1
+    lineStartCycle = scheduler->Now() - (rasterX + 1);
+    if (lineHasDMA) {
+        scheduler->Schedule(evBA, scheduler->Now());
+    }
+    if (badLine && ((rasterX + 1) <= BADLINE_DMA_START)) {
+        scheduler->Schedule(evBadLineDMA, lineStartCycle + BADLINE_DMA_START);
+    }
+    ScheduleNextSync();
+}
+
+template<const VICModel &model>
+void VICII<model>::CatchUp() {
+    if (scheduler == nullptr) {
+        return;
+    }
+    auto now = scheduler->Now();
+    while((now - lineStartCycle) >= kCyclesPerLine) {
+        lineStartCycle += kCyclesPerLine;
+        rasterX = 0;
+        StartRasterLine();
+        if (bus != nullptr) {
+            bus->baLow = lineHasDMA && baLowMask.Test(0);
+        }
+        if (badLine) {
+            scheduler->Schedule(evBadLineDMA, lineStartCycle + BADLINE_DMA_START);
+        }
+        ScheduleBAEdge();
+    }
+    rasterX = uint32_t(now - lineStartCycle);
+}
+
+template<const VICModel &model>
+void VICII<model>::OnLineEvent(void *context) {
+    auto vic = static_cast<VICII *>(context);
+    vic->CatchUp();
+    vic->ScheduleNextSync();
+}
 
+template<const VICModel &model>
+void VICII<model>::OnBAEvent(void *context) {
+    auto vic = static_cast<VICII *>(context);
+    vic->CatchUp();
+    if (vic->bus != nullptr) {
+        vic->bus->baLow = vic->baLowMask.Test(vic->rasterX);
+    }
+    vic->ScheduleBAEdge();
+}
+
+template<const VICModel &model>
+void VICII<model>::OnBadLineDMAEvent(void *context) {
+    auto vic = static_cast<VICII *>(context);
+    vic->CatchUp();
+    auto x = vic->rasterX;
+    for(vic->rasterX=BADLINE_DMA_START;vic->rasterX<BADLINE_DMA_END;vic->rasterX++) {
+        vic->HandleBadLine();
+    }
+    vic->rasterX = x;
+}
+
+//
+// Lines can be skipped (caught up later) unless something in them is visible outside the VIC:
+// - the raster IRQ line and the frame end (the frame is handed over)
+// - bad lines and sprite DMA, BA halts the CPU
+// - lines drawing graphics or sprites, they read RAM at the end of the line and must see it as it was then
+// Only border, VBL and unrendered (warp) lines are left - register writes reschedule, so the prediction holds.
+//
+template<const VICModel &model>
+void VICII<model>::ScheduleNextSync() {
+    // The current line is ended at its own end if it reads RAM
+    auto needsEnd = spriteDMA || spriteFetched || ((lineTarget != nullptr) && (rasterYState == OutsideVBL) && !IsInVerticalBorder());
+    auto ctrl1 = GetReg<VICRegControl1>(Control1);
+    auto enabled = Reg(SpriteEnable);
+    uint32_t y = rasterY + 1;
+    while(!needsEnd && (y < model.nVerticalLines) && (y != rasterCompare) && (y != frameEndLine)) {
+        // DEN is ignored, at worst a line is synced for nothing
+        if ((y >= 0x30) && (y <= 0xf7) && ((y & 0x07) == ctrl1->YScroll)) {
+            break;
+        }
+        bool spriteStarts = false;
+        for(uint32_t n=0;n<kNumSprites;n++) {
+            if ((enabled & (1 << n)) && (regs[(Sprite0Y & kRegMask) + n * 2] == (y & 0xff))) {
+                spriteStarts = true;
+            }
+        }
+        if (spriteStarts) {
+            break;
+        }
+        needsEnd = renderFrame && (WindowRow(y) < window.height) && !IsVBL(y) && !IsInVerticalBorder(y, ctrl1->RSEL);
+        y++;
+    }
+    scheduler->Schedule(evLine, lineStartCycle + uint64_t(y - rasterY) * kCyclesPerLine);
 }
-void VIC::RenderToScreen() {
-    // Set to black, initially
-    RGBA col = Pixmap::Black;
+
+// Next cycle within this line where BA changes, the line start takes care of the rest
+template<const VICModel &model>
+void VICII<model>::ScheduleBAEdge() {
+    if (!lineHasDMA) {
+        return;
+    }
+    auto current = baLowMask.Test(rasterX);
+    for(uint32_t x=rasterX + 1;x<kCyclesPerLine;x++) {
+        if (baLowMask.Test(x) != current) {
+            scheduler->Schedule(evBA, lineStartCycle + x);
+            return;
+        }
+    }
+}
+
+template<const VICModel &model>
+void VICII<model>::EndRasterLine() {
+    RenderLine(kCyclesPerLine);
+    // NOTE: Sprites use the registers as they are at the end of the line
+    RenderSprites(lineVisible ? lineTarget : nullptr);
+    if (lineVisible) {
+        auto frameRow = FrameRow(rasterY);
+        if (cropLine) {
+            memcpy(frameRow, &scratchLine[window.x], window.width);
+        }
+        rowHashes[frameBuffers.Back()][WindowRow(rasterY)] = HashRow(frameRow, window.width);
+    }
+    memset(lineForeground, 0, sizeof(lineForeground));
+    FetchSpriteData();
+    UpdateRowCounter();
+    lineRenderedCycle = 0;
+    // Also picks up the raster counter, which is updated without events
+    memcpy(lineRegs, regs, sizeof(regs));
+}
+
+// Draws cycles [lineRenderedCycle, endCycle) of the current line, 8 pixels per cycle
+// The line is drawn in segments, the registers are constant within a segment
+template<const VICModel &model>
+void VICII<model>::RenderLine(uint32_t endCycle) {
+    static_assert(kCyclesPerLine * 8 <= kScreenWidth);
+    size_t idxEvent = 0;
+    if (lineTarget != nullptr) {
+        auto row = lineTarget;
+        auto verticalBorder = IsInVerticalBorder();
+        auto cycle = lineRenderedCycle;
+        while(cycle < endCycle) {
+            // Apply writes from previous cycles
+            while((idxEvent < nRegEvents) && (regEvents[idxEvent].cycle < cycle)) {
+                lineRegs[regEvents[idxEvent].idxReg] = regEvents[idxEvent].value;
+                idxEvent++;
+            }
+            // The next write is seen from the cycle after it
+            auto segmentEnd = endCycle;
+            if ((idxEvent < nRegEvents) && ((regEvents[idxEvent].cycle + 1u) < segmentEnd)) {
+                segmentEnd = regEvents[idxEvent].cycle + 1;
+            }
+            // Nothing outside the window is drawn
+            auto c0 = std::max(cycle, windowFirstCycle);
+            auto c1 = std::min(segmentEnd, windowLastCycle);
+            if (c0 < c1) {
+                RenderSegment(row, c0, c1, verticalBorder);
+            }
+            cycle = segmentEnd;
+        }
+    }
+    // Whatever is left only affects cycles after the ones drawn
+    for(;idxEvent < nRegEvents; idxEvent++) {
+        lineRegs[regEvents[idxEvent].idxReg] = regEvents[idxEvent].value;
+    }
+    nRegEvents = 0;
+    lineRenderedCycle = endCycle;
+}
+
+// Fills [x0, x1) clipped to [clipMin, clipMax)
+static inline void FillSpan(uint8_t *row, uint32_t x0, uint32_t x1, uint32_t clipMin, uint32_t clipMax, uint8_t col) {
+    if (x0 < clipMin) x0 = clipMin;
+    if (x1 > clipMax) x1 = clipMax;
+    if (x0 < x1) {
+        memset(&row[x0], col, x1 - x0);
+    }
+}
+
+//
+// Line masks, one bit per pixel - LSB is the leftmost pixel
+//
+static inline uint8_t ReverseBits(uint8_t b) {
+    b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+    b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+    b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+    return b;
+}
+
+// 64 pixels starting at 'x'
+static inline uint64_t ExtractBits(const uint64_t *bits, uint32_t x) {
+    auto idx = x >> 6;
+    auto shift = x & 63;
+    uint64_t v = bits[idx] >> shift;
+    if (shift) {
+        v |= bits[idx + 1] << (64 - shift);
+    }
+    return v;
+}
+
+static inline void InsertBits(uint64_t *bits, uint32_t x, uint64_t v) {
+    auto idx = x >> 6;
+    auto shift = x & 63;
+    bits[idx] |= v << shift;
+    if (shift) {
+        bits[idx + 1] |= v >> (64 - shift);
+    }
+}
+
+// Bits for the pixels within [first, last) of a 64 pixel window starting at 'x'
+static inline uint64_t RangeMask(uint32_t x, uint32_t first, uint32_t last) {
+    auto lo = std::clamp<int32_t>(int32_t(first) - int32_t(x), 0, 64);
+    auto hi = std::clamp<int32_t>(int32_t(last) - int32_t(x), 0, 64);
+    if (lo >= hi) {
+        return 0;
+    }
+    uint64_t maskHi = (hi == 64) ? ~uint64_t(0) : ((uint64_t(1) << hi) - 1);
+    return maskHi & ~((uint64_t(1) << lo) - 1);
+}
+
+template<const VICModel &model>
+void VICII<model>::RenderSegment(uint8_t *row, uint32_t firstCycle, uint32_t lastCycle, bool verticalBorder) {
+    auto x0 = firstCycle * 8;
+    auto x1 = lastCycle * 8;
     if (rasterYState == InsideVBL) {
-        col = Pixmap::Red;
-    } else {
-        switch (rasterXState) {
-            case InsideBorder :
-                col = palette[ram[BorderCol] & 0x0f];
-                break;
-            case InsideMain :
-                // TODO
-                // - Check video mode and fetch byte to draw...
-                col = palette[ram[BackgroundCol] & 0x0f];
-                break;
+        FillSpan(row, x0, x1, x0, x1, Black);
+        return;
+    }
+    auto ctrl2 = GetLineReg<VICRegControl2>(Control2);
+    if (!verticalBorder) {
+        // Graphics, shifted right by XSCROLL - the border is drawn on top
+        auto c0 = std::max<uint32_t>(firstCycle, FIRST_COLUMN_CYCLE);
+        auto c1 = std::min<uint32_t>(lastCycle, FIRST_COLUMN_CYCLE + NUM_COLUMNS);
+        if (c0 < c1) {
+            auto xScroll = ctrl2->XScroll;
+            if (c0 == FIRST_COLUMN_CYCLE) {
+                FillSpan(row, MAIN_FIRST_X, MAIN_FIRST_X + xScroll, 0, kScreenWidth, LineColor(BackgroundCol));
+            }
+            auto renderer = displayState ? graphicsRenderers[GraphicsMode()] : &VICII::RenderIdle;
+            (this->*renderer)(&row[c0 * 8 + xScroll], c0 - FIRST_COLUMN_CYCLE, c1 - c0);
+            for(auto c=c0;c<c1;c++) {
+                InsertBits(lineForeground, c * 8 + xScroll, ReverseBits(columnForeground[c - FIRST_COLUMN_CYCLE]));
+            }
         }
     }
-    // Draw this tick...
-    for(int i=0;i<8;i++) {
-        // Not quite right...
-        screen.PutPixel(rasterX * 8 + i, rasterY, col);
+    // HBL
+    FillSpan(row, x0, x1, 0, BORDER_FIRST_X, Black);
+    FillSpan(row, x0, x1, BORDER_LAST_X, kScreenWidth, Black);
+
+    // Border, 38 columns (CSEL=0) covers 7 more pixels on the left and 9 on the right
+    auto windowLeft = MAIN_FIRST_X + (ctrl2->CSEL ? 0 : 7);
+    auto windowRight = MAIN_FIRST_X + NUM_COLUMNS * 8 - (ctrl2->CSEL ? 0 : 9);
+    if (verticalBorder) {
+        windowLeft = windowRight = BORDER_LAST_X;
     }
+    auto borderCol = LineColor(BorderCol);
+    FillSpan(row, x0, x1, BORDER_FIRST_X, windowLeft, borderCol);
+    FillSpan(row, x0, x1, windowRight, BORDER_LAST_X, borderCol);
 }
 
-void VIC::UpdateHorizontalState() {
+template<const VICModel &model>
+void VICII<model>::UpdateHorizontalState() {
     rasterX++;
-    if (rasterX == 63) {
+    if (rasterX == kCyclesPerLine) {
         rasterX = 0;
     }
+}
+
+//
+// Warp mode
+//
+template<const VICModel &model>
+void VICII<model>::SetRenderInterval(uint32_t nFrames) {
+    renderInterval = nFrames;
+}
+
+template<const VICModel &model>
+void VICII<model>::RequestFrame() {
+    frameRequested = true;
+}
+
+template<const VICModel &model>
+void VICII<model>::BeginFrame() {
+    if (renderFrame) {
+        nFramesRendered++;
+        // Hand the completed frame to the presentation side and continue in the spare one
+        completedFrame = frame;
+        frameBuffers.Publish();
+        frame = frames[frameBuffers.Back()];
+    }
+    nFrames++;
+    renderFrame = frameRequested || ((renderInterval != 0) && ((nFrames % renderInterval) == 0));
+    frameRequested = false;
+}
 
-    if (rasterYState == InsideVBL) {
-        // Don't track raster X states if we are within VBL
-        rasterXState = Invalid;
+// Lines outside rendered frames are only drawn (to a scratch line) when sprites needs the collisions
+template<const VICModel &model>
+void VICII<model>::SelectLineTarget() {
+    lineVisible = renderFrame && (WindowRow(rasterY) < window.height);
+    if (lineVisible) {
+        lineTarget = cropLine ? scratchLine : FrameRow(rasterY);
+    } else if (spriteFetched) {
+        lineTarget = scratchLine;
+    } else {
+        lineTarget = nullptr;
+    }
+}
+
+// Figure out which cycles the VIC needs the bus for this line
+template<const VICModel &model>
+void VICII<model>::BeginRasterLine() {
+    SelectLineTarget();
+    baLowMask.Clear();
+
+    if (rasterY == 0x30) {
+        denLatched = GetReg<VICRegControl1>(Control1)->DEN;
     }
+    badLine = IsBadLine();
+    if (badLine) {
+        baLowMask.SetRange(BADLINE_BA_START, BADLINE_DMA_END);
+        displayState = true;
+        videoRowCounter = 0;
+    }
+    videoMatrixCounter = videoMatrixBase;
+    UpdateSpriteDMA();
+    lineHasDMA = baLowMask.Any();
+    if (!lineHasDMA && (bus != nullptr)) {
+        bus->baLow = false;
+    }
+}
+
+template<const VICModel &model>
+void VICII<model>::HandleDMA() {
+    if (bus != nullptr) {
+        bus->baLow = baLowMask.Test(rasterX);
+    }
+    if (badLine && (rasterX >= BADLINE_DMA_START) && (rasterX < BADLINE_DMA_END)) {
+        HandleBadLine();
+    }
+}
+
+// c-access, suck in the video matrix and colour ram - one char per cycle
+template<const VICModel &model>
+void VICII<model>::HandleBadLine() {
+    auto idxChar = rasterX - BADLINE_DMA_START;
+    auto ptrs = GetReg<VICRegMemoryPointers>(MemoryPointers);
+    uint16_t vc = (videoMatrixCounter + idxChar) & 0x3ff;
+    chars[idxChar] = VicRead((ptrs->VM << 10) | vc);
+    colors[idxChar] = ram.ColorRAM()[vc] & 0x0f;
+}
+
+//
+// Sprites
+//
+// The sequencing is compressed to the line boundaries: the cycle 15/16 and 55/56 checks are done when the line
+// begins (so the BA mask is known up front), the cycle 58 MC reload and the s-accesses when the line ends.
+// see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt (section 3.8.1)
+//
+
+template<const VICModel &model>
+void VICII<model>::UpdateSpriteDMA() {
+    auto enabled = Reg(SpriteEnable);
+    auto yExpand = Reg(SpriteYExpand);
 
-    if ((rasterX >= 11) && (rasterX < 16)) {
-        rasterXState = InsideBorder;
-    } else if ((rasterX >= 16) && (rasterX < 56)) {
-        if (IsInVerticalBorder()) {
-            rasterXState = InsideBorder;
+    // Sprites 3-7 fetched at the end of the previous line finish here
+    for(uint32_t n=3;n<kNumSprites;n++) {
+        if (spriteFetched & (1 << n)) {
+            auto cycle = SpriteFetchCycle(n);
+            baLowMask.SetRange(cycle >= Bus::kBAGraceCycles ? cycle - Bus::kBAGraceCycles : 0, cycle + 2);
+        }
+    }
+
+    for(uint32_t n=0;n<kNumSprites;n++) {
+        auto &sprite = sprites[n];
+        auto bit = 1 << n;
+        // Cycle 15/16
+        if (sprite.expandFF) {
+            sprite.mcBase = (sprite.mcBase + 3) & 0x3f;
+            if (sprite.mcBase == 63) {
+                spriteDMA &= ~bit;
+            }
+        }
+        // Cycle 55/56
+        if (yExpand & bit) {
+            sprite.expandFF = !sprite.expandFF;
         } else {
-            rasterXState = InsideMain;
+            sprite.expandFF = true;
+        }
+        if ((enabled & bit) && !(spriteDMA & bit) && (regs[(Sprite0Y & kRegMask) + n * 2] == (rasterY & 0xff))) {
+            spriteDMA |= bit;
+            sprite.mcBase = 0;
+            if (yExpand & bit) {
+                sprite.expandFF = false;
+            }
+        }
+        if (!(spriteDMA & bit)) {
+            continue;
+        }
+        auto cycle = SpriteFetchCycle(n);
+        if (n < 3) {
+            baLowMask.SetRange(cycle - Bus::kBAGraceCycles, cycle + 2);
+        } else if (cycle < Bus::kBAGraceCycles) {
+            // BA goes low at the end of this line
+            baLowMask.SetRange(kCyclesPerLine + cycle - Bus::kBAGraceCycles, kCyclesPerLine);
         }
-    } else if ((rasterX >= 56) && (rasterX < 61)) {
-        rasterXState = InsideBorder;
-    } else if (rasterX >= 61) {
-        rasterXState = InsideHBL;
-    } else {
-        // < 11
-        rasterXState = InsideHBL;
     }
 }
 
-void VIC::HandleBadLine() {
-    if (!cpuStunned) {
-        cpuStunned = true;
-        videoRowCounter = 0;
-        stunCycleCount = 0;
-    } else {
-        if (stunCycleCount < 40) {
-            chars[stunCycleCount] = ram[videoMatrixAddress + videoMatrixCounter];
-            videoMatrixCounter++;
-            stunCycleCount++;
+// Cycle 58 and the p/s-accesses, three bytes per sprite for the next line
+template<const VICModel &model>
+void VICII<model>::FetchSpriteData() {
+    auto ptrs = GetReg<VICRegMemoryPointers>(MemoryPointers);
+    uint16_t ptrBase = (ptrs->VM << 10) | SPRITE_POINTERS_OFFSET;
+    for(uint32_t n=0;n<kNumSprites;n++) {
+        auto &sprite = sprites[n];
+        sprite.mc = sprite.mcBase;
+        if (!(spriteDMA & (1 << n))) {
+            continue;
+        }
+        uint16_t dataAddress = VicRead(ptrBase + n) << 6;
+        sprite.data = 0;
+        for(int i=0;i<3;i++) {
+            sprite.data = (sprite.data << 8) | VicRead(dataAddress + sprite.mc);
+            sprite.mc = (sprite.mc + 1) & 0x3f;
+        }
+    }
+    spriteFetched = spriteDMA;
+}
+
+// Colour select for pixel 'i' of a sprite line, 0 is transparent, 1/3 are the shared multicolors
+static inline uint8_t SpritePixel(uint32_t data, bool multiColor, bool expandX, uint32_t i) {
+    auto idx = expandX ? (i >> 1) : i;
+    if (multiColor) {
+        return (data >> (22 - (idx & ~1u))) & 3;
+    }
+    return ((data >> (23 - idx)) & 1) ? 2 : 0;
+}
+
+// Collisions are detected on 64 pixel masks, one per sprite, sprite 0 has the highest priority
+template<const VICModel &model>
+void VICII<model>::RenderSprites(uint8_t *row) {
+    if (!spriteFetched) {
+        return;
+    }
+    auto xMSB = LineReg(SpriteXMSB);
+    auto multiColorBits = LineReg(SpriteMultiColor);
+    auto expandXBits = LineReg(SpriteXExpand);
+    auto priorityBits = LineReg(SpritePriority);
+
+    uint64_t masks[kNumSprites] = {};
+    uint32_t xPos[kNumSprites] = {};
+    for(uint32_t n=0;n<kNumSprites;n++) {
+        auto bit = 1 << n;
+        if (!(spriteFetched & bit)) {
+            continue;
+        }
+        // Sprite X 24 is the first pixel of the 40 column display window, X >= 504 is never displayed
+        uint32_t x = lineRegs[(Sprite0X & kRegMask) + n * 2] | ((xMSB & bit) ? 0x100 : 0);
+        x += SPRITE_X_TO_LINE;
+        if (x >= (kCyclesPerLine * 8)) {
+            x -= kCyclesPerLine * 8;
+        }
+        xPos[n] = x;
+        auto width = (expandXBits & bit) ? 48 : 24;
+        for(int i=0;i<width;i++) {
+            if (SpritePixel(sprites[n].data, multiColorBits & bit, expandXBits & bit, i)) {
+                masks[n] |= uint64_t(1) << i;
+            }
+        }
+    }
+
+    // Collisions
+    uint8_t spriteCollisions = 0;
+    uint8_t backgroundCollisions = 0;
+    for(uint32_t a=0;a<kNumSprites;a++) {
+        if (!masks[a]) {
+            continue;
+        }
+        if (ExtractBits(lineForeground, xPos[a]) & masks[a]) {
+            backgroundCollisions |= 1 << a;
+        }
+        for(uint32_t b=a+1;b<kNumSprites;b++) {
+            if (!masks[b]) {
+                continue;
+            }
+            uint64_t overlap = 0;
+            if ((xPos[a] <= xPos[b]) && ((xPos[b] - xPos[a]) < 64)) {
+                overlap = (masks[a] >> (xPos[b] - xPos[a])) & masks[b];
+            } else if ((xPos[b] < xPos[a]) && ((xPos[a] - xPos[b]) < 64)) {
+                overlap = (masks[b] >> (xPos[a] - xPos[b])) & masks[a];
+            }
+            if (overlap) {
+                spriteCollisions |= (1 << a) | (1 << b);
+            }
+        }
+    }
+    // Only the first collision after the register was cleared raises an interrupt
+    if (spriteCollisions && !Reg(SpriteSpriteCollision)) {
+        RaiseIRQ(kIRQSpriteSprite);
+    }
+    if (backgroundCollisions && !Reg(SpriteBackgroundCollision)) {
+        RaiseIRQ(kIRQSpriteBackground);
+    }
+    Reg(SpriteSpriteCollision) |= spriteCollisions;
+    Reg(SpriteBackgroundCollision) |= backgroundCollisions;
+
+    if ((row == nullptr) || (rasterYState == InsideVBL) || IsInVerticalBorder()) {
+        return;
+    }
+
+    // Drawing, the border covers the sprites
+    auto ctrl2 = GetLineReg<VICRegControl2>(Control2);
+    auto windowLeft = MAIN_FIRST_X + (ctrl2->CSEL ? 0 : 7);
+    auto windowRight = MAIN_FIRST_X + NUM_COLUMNS * 8 - (ctrl2->CSEL ? 0 : 9);
+    const uint8_t spriteColors[4] = {
+            Black,
+            LineColor(SpriteMultiColor0),
+            Black,
+            LineColor(SpriteMultiColor1),
+    };
+    uint64_t occupied[kLineMaskWords] = {};
+    for(uint32_t n=0;n<kNumSprites;n++) {
+        if (!masks[n]) {
+            continue;
+        }
+        auto bit = 1 << n;
+        auto x = xPos[n];
+        // Lower priority sprites are hidden by this one, even where it is behind the foreground
+        auto visible = masks[n] & ~ExtractBits(occupied, x) & RangeMask(x, windowLeft, windowRight);
+        InsertBits(occupied, x, masks[n]);
+        if (priorityBits & bit) {
+            visible &= ~ExtractBits(lineForeground, x);
+        }
+        uint8_t colors[4] = { spriteColors[0], spriteColors[1], uint8_t(lineRegs[(Sprite0Col & kRegMask) + n] & 0x0f), spriteColors[3] };
+        while(visible) {
+            auto i = std::countr_zero(visible);
+            row[x + i] = colors[SpritePixel(sprites[n].data, multiColorBits & bit, expandXBits & bit, i)];
+            visible &= visible - 1;
+        }
+    }
+}
+
+// Cycle 58, see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt (section 3.7.2)
+template<const VICModel &model>
+void VICII<model>::UpdateRowCounter() {
+    if (videoRowCounter == 7) {
+        // VC is only incremented by the g-accesses in display state
+        if (displayState) {
+            videoMatrixBase = (videoMatrixCounter + 40) & 0x3ff;
+        }
+        if (!badLine) {
+            displayState = false;
+        }
+    }
+    if (displayState) {
+        videoRowCounter = (videoRowCounter + 1) & 7;
+    }
+}
+
+// The VIC sees 16k of RAM, CHARGEN is visible at $1000 - $1fff in bank 0 and 2
+template<const VICModel &model>
+uint8_t VICII<model>::VicRead(uint16_t address) {
+    address &= 0x3fff;
+    auto chargen = ram.GetROM(Memory::Rom::CharGen);
+    if (((address & 0x3000) == 0x1000) && !(bankAddress & 0x4000) && (chargen != nullptr)) {
+        return chargen[address & 0x0fff];
+    }
+    return ram[bankAddress + address];
+}
+
+//
+// Graphics modes, one renderer per ECM/BMM/MCM combination - see section 3.7.3
+// Each draws 'nColumns' g-accesses starting at 'firstColumn', 8 pixels each
+//
+template<const VICModel &model>
+const typename VICII<model>::GraphicsRenderer VICII<model>::graphicsRenderers[8] = {
+    &VICII::RenderStandardText,       // ECM=0, BMM=0, MCM=0
+    &VICII::RenderMultiColorText,     // ECM=0, BMM=0, MCM=1
+    &VICII::RenderHiResBitmap,        // ECM=0, BMM=1, MCM=0
+    &VICII::RenderMultiColorBitmap,   // ECM=0, BMM=1, MCM=1
+    &VICII::RenderExtendedColorText,  // ECM=1, BMM=0, MCM=0
+    &VICII::RenderInvalid,            // ECM=1, BMM=0, MCM=1
+    &VICII::RenderInvalid,            // ECM=1, BMM=1, MCM=0
+    &VICII::RenderInvalid,            // ECM=1, BMM=1, MCM=1
+};
+
+template<const VICModel &model>
+uint8_t VICII<model>::GraphicsMode() const {
+    auto ctrl1 = GetLineReg<VICRegControl1>(Control1);
+    auto ctrl2 = GetLineReg<VICRegControl2>(Control2);
+    return (ctrl1->ECM << 2) | (ctrl1->BMM << 1) | ctrl2->MCM;
+}
+
+template<const VICModel &model>
+inline uint8_t VICII<model>::FetchCharData(uint8_t ch) {
+    auto ptrs = GetLineReg<VICRegMemoryPointers>(MemoryPointers);
+    return VicRead((ptrs->CB << 11) | (ch << 3) | videoRowCounter);
+}
+
+template<const VICModel &model>
+inline uint16_t VICII<model>::FetchBitmapAddress(uint32_t column) {
+    auto ptrs = GetLineReg<VICRegMemoryPointers>(MemoryPointers);
+    uint16_t vc = (videoMatrixCounter + column) & 0x3ff;
+    return ((ptrs->CB & 0x04) << 11) | (vc << 3) | videoRowCounter;
+}
+
+template<const VICModel &model>
+inline uint8_t VICII<model>::FetchBitmapData(uint32_t column) {
+    return VicRead(FetchBitmapAddress(column));
+}
+
+// In multicolor, only the '10' and '11' bit pairs are foreground
+static inline uint8_t MultiColorForeground(uint8_t bits) {
+    uint8_t fg = bits & 0xaa;
+    return fg | (fg >> 1);
+}
+
+template<const VICModel &model>
+void VICII<model>::RenderStandardText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    uint8_t bg[NUM_COLUMNS];
+    memset(bg, LineColor(BackgroundCol), nColumns);
+    for(uint32_t i=firstColumn;i<firstColumn + nColumns;i++) {
+        columnForeground[i] = FetchCharData(chars[i]);
+    }
+    PixelExpand::HiResSpan(dst, &columnForeground[firstColumn], &colors[firstColumn], bg, nColumns);
+}
+
+// Colour RAM bit 3 selects multicolor per character, otherwise hi-res in the lower 8 colors
+template<const VICModel &model>
+void VICII<model>::RenderMultiColorText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    uint8_t mcColors[4] = {
+            LineColor(BackgroundCol),
+            LineColor(BackgroundCol1),
+            LineColor(BackgroundCol2),
+    };
+    for(uint32_t i=firstColumn;i<firstColumn + nColumns;i++, dst += 8) {
+        auto bits = FetchCharData(chars[i]);
+        mcColors[3] = uint8_t(colors[i] & 0x07);
+        if (colors[i] & 0x08) {
+            columnForeground[i] = MultiColorForeground(bits);
+            PixelExpand::MultiColor(dst, bits, mcColors);
         } else {
-            cpuStunned = false;
+            columnForeground[i] = bits;
+            PixelExpand::HiRes(dst, bits, mcColors[3], mcColors[0]);
         }
     }
+}
+
+template<const VICModel &model>
+void VICII<model>::RenderHiResBitmap(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    uint8_t fg[NUM_COLUMNS], bg[NUM_COLUMNS];
+    for(uint32_t i=0;i<nColumns;i++) {
+        auto column = firstColumn + i;
+        columnForeground[column] = FetchBitmapData(column);
+        fg[i] = uint8_t(chars[column] >> 4);
+        bg[i] = uint8_t(chars[column] & 0x0f);
+    }
+    PixelExpand::HiResSpan(dst, &columnForeground[firstColumn], fg, bg, nColumns);
+}
+
+template<const VICModel &model>
+void VICII<model>::RenderMultiColorBitmap(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    uint8_t bits[NUM_COLUMNS], c0[NUM_COLUMNS], c1[NUM_COLUMNS], c2[NUM_COLUMNS];
+    memset(c0, LineColor(BackgroundCol), nColumns);
+    for(uint32_t i=0;i<nColumns;i++) {
+        auto column = firstColumn + i;
+        bits[i] = FetchBitmapData(column);
+        c1[i] = uint8_t(chars[column] >> 4);
+        c2[i] = uint8_t(chars[column] & 0x0f);
+        columnForeground[column] = MultiColorForeground(bits[i]);
+    }
+    PixelExpand::MultiColorSpan(dst, bits, c0, c1, c2, &colors[firstColumn], nColumns);
+}
+
+// Upper two bits of the character selects the background, only 64 characters
+template<const VICModel &model>
+void VICII<model>::RenderExtendedColorText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    const uint8_t backgrounds[4] = {
+            LineColor(BackgroundCol),
+            LineColor(BackgroundCol1),
+            LineColor(BackgroundCol2),
+            LineColor(BackgroundCol3),
+    };
+    uint8_t bg[NUM_COLUMNS];
+    for(uint32_t i=0;i<nColumns;i++) {
+        auto column = firstColumn + i;
+        columnForeground[column] = FetchCharData(chars[column] & 0x3f);
+        bg[i] = backgrounds[chars[column] >> 6];
+    }
+    PixelExpand::HiResSpan(dst, &columnForeground[firstColumn], &colors[firstColumn], bg, nColumns);
+}
 
-    // TODO:
-    //  - Suck in video matrix information
-    //  - SetCPU in 'STUN' mode for 40 cycles...
+// The invalid modes are all black, the graphics are still fetched (with ECM clearing address bits 9 and 10)
+// and the foreground still collides with sprites
+template<const VICModel &model>
+void VICII<model>::RenderInvalid(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    auto mode = GraphicsMode();
+    for(uint32_t i=firstColumn;i<firstColumn + nColumns;i++, dst += 8) {
+        uint8_t bits;
+        bool multiColor;
+        if (mode & 0x02) {
+            bits = VicRead(FetchBitmapAddress(i) & 0x39ff);
+            multiColor = (mode & 0x01);
+        } else {
+            bits = FetchCharData(chars[i] & 0x3f);
+            multiColor = (colors[i] & 0x08);
+        }
+        columnForeground[i] = multiColor ? MultiColorForeground(bits) : bits;
+        PixelExpand::Fill(dst, Black);
+    }
 }
 
-bool VIC::IsBadLine() {
+// Idle state, g-access from $3fff ($39ff with ECM) and the video matrix reads as zero
+template<const VICModel &model>
+void VICII<model>::RenderIdle(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns) {
+    auto mode = GraphicsMode();
+    auto bits = VicRead((mode & 0x04) ? IDLE_GFX_ADDR_ECM : IDLE_GFX_ADDR);
+    auto background = LineColor(BackgroundCol);
+    auto foreground = ((mode & 0x03) == 0x03) ? MultiColorForeground(bits) : bits;
+    memset(&columnForeground[firstColumn], foreground, nColumns);
+
+    uint8_t fg = Black;
+    uint8_t bg = background;
+    switch(mode) {
+        case 0x00 :
+        case 0x01 :
+        case 0x04 :
+            break;
+        case 0x03 : {
+            const uint8_t mcColors[4] = { background, Black, Black, Black };
+            for(uint32_t i=0;i<nColumns;i++, dst += 8) {
+                PixelExpand::MultiColor(dst, bits, mcColors);
+            }
+            return;
+        }
+        default :
+            bg = Black;
+            break;
+    }
+    for(uint32_t i=0;i<nColumns;i++, dst += 8) {
+        PixelExpand::HiRes(dst, bits, fg, bg);
+    }
+}
+
+template<const VICModel &model>
+bool VICII<model>::IsBadLine() {
     // Not quite sure about these values...
     // see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt   (section 3.5)
     if (rasterY < 0x30) return false;
     if (rasterY > 0xf7) return false;
 
+    if (!denLatched) return false;
+
     auto ctrl = GetReg<VICRegControl1>(Control1);
     if ((rasterY & 0x07) == (ctrl->YScroll)) {
         return true;
     }
+    return false;
 }
 
 
 
-bool VIC::IsVBL() {
-    if (rasterY >= vic6569.vblBegin) {
-        return true;
-    }
-    if (rasterY <= vic6569.vblEnd) {
-        return true;
-    }
-    return false;
+template<const VICModel &model>
+bool VICII<model>::IsVBL() {
+    return IsVBL(rasterY);
 }
 
-bool VIC::IsInVerticalBorder() {
-    // NOTE: This depends on RSEL
-    if (rasterY < 50) return true;
-    if (rasterY > 250) return true;
-    return false;
+template<const VICModel &model>
+bool VICII<model>::IsInVerticalBorder() {
+    return IsInVerticalBorder(rasterY, GetLineReg<VICRegControl1>(Control1)->RSEL);
 }
 
-void VIC::UpdateVerticalState() {
+template<const VICModel &model>
+void VICII<model>::UpdateVerticalState() {
     if (rasterX == 0) {
         rasterY++;
-        videoRowCounter++;  //
     }
 
-    if (rasterY > vic6569.nVerticalLines) {
+    if (rasterY >= model.nVerticalLines) {
         // TODO: reset/clear all per-frame variables...
         rasterY = 0;
-        videoMatrixCounter = 0;
+        videoMatrixBase = 0;
+    }
+    // Line 0 unless the window wraps past it
+    if (rasterY == frameEndLine) {
+        BeginFrame();
     }
     if (IsVBL()) {
         rasterYState = InsideVBL;
@@ -222,3 +1160,7 @@ void VIC::UpdateVerticalState() {
 
 }
 
+template class VICII<VICModels::MOS6569>;
+template class VICII<VICModels::MOS6567R8>;
+template class VICII<VICModels::MOS6567R56A>;
+template class VICII<VICModels::MOS6572>;
@@ -5,17 +5,90 @@
 #ifndef EMU6502_VIC_H
 #define EMU6502_VIC_H
 
+#include <memory>
 #include "Pixmap.h"
 #include "memory.h"
+#include "bus.h"
+#include "triplebuffer.h"
+#include "dirtyrows.h"
+#include "scheduler.h"
 
 
-typedef struct {
+//
+// Chip variants, all timing is compile time - the VIC is instantiated per model
+// see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt (section 2.4 and 3.3)
+//
+struct VICModel {
+    const char *name;
+    uint32_t cpuClockHz;
     // Raster Y
-    int32_t nVerticalLines;
-    int32_t vblBegin;
-    int32_t vblEnd;
-    // Raster X
-} VicType;
+    uint32_t nVerticalLines;
+    uint32_t vblBegin;          // VBL is [vblBegin, vblEnd], wraps past line 0 when vblBegin > vblEnd
+    uint32_t vblEnd;
+    // Raster X, 0 based cycles
+    uint32_t cyclesPerLine;
+    uint32_t firstColumnCycle;  // first g-access
+    uint32_t sprite0FetchCycle; // p-access of sprite 0, the others follow every second cycle
+    uint32_t hblEndCycle;       // HBL is outside [hblEndCycle, hblBeginCycle)
+    uint32_t hblBeginCycle;
+
+    constexpr double FrameRate() const { return double(cpuClockHz) / (double(cyclesPerLine) * nVerticalLines); }
+};
+
+namespace VICModels {
+    // PAL
+    inline constexpr VICModel MOS6569 = {
+            .name = "6569 (PAL-B)",
+            .cpuClockHz = 985248,
+            .nVerticalLines = 312,
+            .vblBegin = 300,
+            .vblEnd = 15,
+            .cyclesPerLine = 63,
+            .firstColumnCycle = 16,
+            .sprite0FetchCycle = 57,
+            .hblEndCycle = 11,
+            .hblBeginCycle = 61,
+    };
+    // NTSC
+    inline constexpr VICModel MOS6567R8 = {
+            .name = "6567R8 (NTSC-M)",
+            .cpuClockHz = 1022727,
+            .nVerticalLines = 263,
+            .vblBegin = 13,
+            .vblEnd = 40,
+            .cyclesPerLine = 65,
+            .firstColumnCycle = 16,
+            .sprite0FetchCycle = 59,
+            .hblEndCycle = 11,
+            .hblBeginCycle = 63,
+    };
+    // Early NTSC, one cycle and one line less than the R8
+    inline constexpr VICModel MOS6567R56A = {
+            .name = "6567R56A (NTSC-M)",
+            .cpuClockHz = 1022727,
+            .nVerticalLines = 262,
+            .vblBegin = 13,
+            .vblEnd = 40,
+            .cyclesPerLine = 64,
+            .firstColumnCycle = 16,
+            .sprite0FetchCycle = 58,
+            .hblEndCycle = 11,
+            .hblBeginCycle = 62,
+    };
+    // Drean (PAL-N), PAL lines with NTSC line length
+    inline constexpr VICModel MOS6572 = {
+            .name = "6572 (PAL-N)",
+            .cpuClockHz = 1023440,
+            .nVerticalLines = 312,
+            .vblBegin = 300,
+            .vblEnd = 15,
+            .cyclesPerLine = 65,
+            .firstColumnCycle = 16,
+            .sprite0FetchCycle = 59,
+            .hblEndCycle = 11,
+            .hblBeginCycle = 63,
+    };
+}
 
 
 #pragma pack(push, 1)
@@ -32,10 +105,38 @@ typedef struct {
     uint8_t COUNTER;
 } VICRegRaster;
 
+typedef struct {
+    uint8_t XScroll : 3;    // 0..7
+    uint8_t CSEL : 1;   // Column Select
+    uint8_t MCM : 1;    // Multi Color Mode
+    uint8_t RES : 1;
+    uint8_t unused : 2;
+} VICRegControl2;
+
+typedef struct {
+    uint8_t unused : 1;
+    uint8_t CB : 3;     // Character base, bits 11..13 (bit 13 is the bitmap base)
+    uint8_t VM : 4;     // Video matrix, bits 10..13
+} VICRegMemoryPointers;
+
 #pragma pack(pop)
 
-// http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt
-class VIC {
+// Part of the raster stored in the frame
+enum class VICGeometry : uint8_t {
+    Full = 0,           // every cycle of every line, including blanking
+    Visible = 1,        // what a monitor shows, border included - no blanking
+    MainWindow = 2,     // the 320x200 display window only
+};
+
+struct VICWindow {
+    uint32_t x;         // raster X in pixels (cycle * 8)
+    uint32_t y;         // raster line
+    uint32_t width;
+    uint32_t height;
+};
+
+// Model independent definitions, shared by all variants
+class VICBase {
 public:
     enum Color {
         Black = 0,
@@ -66,51 +167,311 @@ public:
         InsideMain = 3,
     };
     enum Regs {
+        Sprite0X = 0xd000,      // X/Y pairs for all 8 sprites, $d000 - $d00f
+        Sprite0Y = 0xd001,
+        SpriteXMSB = 0xd010,
         Control1 = 0xd011,
         Raster = 0xd012,
+        SpriteEnable = 0xd015,
         Control2 = 0xd016,
+        SpriteYExpand = 0xd017,
+        MemoryPointers = 0xd018,
+        InterruptStatus = 0xd019,   // Latch, write 1 to acknowledge
+        InterruptEnable = 0xd01a,
+        SpritePriority = 0xd01b,    // 1 - behind the foreground graphics
+        SpriteMultiColor = 0xd01c,
+        SpriteXExpand = 0xd01d,
+        SpriteSpriteCollision = 0xd01e,
+        SpriteBackgroundCollision = 0xd01f,
         BorderCol = 0xd020,
         BackgroundCol = 0xd021,
+        BackgroundCol1 = 0xd022,
+        BackgroundCol2 = 0xd023,
+        BackgroundCol3 = 0xd024,
+        SpriteMultiColor0 = 0xd025,
+        SpriteMultiColor1 = 0xd026,
+        Sprite0Col = 0xd027,        // colours for all 8 sprites, $d027 - $d02e
     };
 public:
-    VIC(Memory &memory);
+    static const RGBA *Palette();
+};
+
+// http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt
+template<const VICModel &model>
+class VICII : public VICBase, public MemoryMappedIO {
+public:
+    static constexpr const VICModel &kModel = model;
+    // Full raster, one pixel per raster X position (8 per cycle), padded to 64 pixel words
+    static constexpr size_t kScreenWidth = (model.cyclesPerLine * 8 + 63) & ~size_t(63);
+    static constexpr size_t kScreenHeight = model.nVerticalLines;
+    // The frame is rendered as palette indices, one byte per pixel - this is the size of the full raster (largest)
+    static constexpr size_t ScreenBufferSize() { return kScreenWidth * kScreenHeight; }
+    // Frames are triple buffered, an external buffer holds all three
+    static const size_t kNumFrameBuffers = 3;
+    static constexpr size_t ExternalBufferSize() { return kNumFrameBuffers * ScreenBufferSize(); }
+    static constexpr uint32_t kVBLLines = (model.vblBegin > model.vblEnd) ?
+            (model.nVerticalLines - model.vblBegin + model.vblEnd + 1) : (model.vblEnd - model.vblBegin + 1);
+    // 'Visible' starts after the VBL and ends where it begins. The NTSC VBL is in the middle of the raster
+    // ([13,40]), so the window wraps past line 0 - see WindowRow()
+    static constexpr VICWindow Window(VICGeometry geometry) {
+        switch(geometry) {
+            case VICGeometry::Visible :
+                return { model.hblEndCycle * 8, (model.vblEnd + 1) % model.nVerticalLines,
+                         (model.hblBeginCycle - model.hblEndCycle) * 8,
+                         model.nVerticalLines - kVBLLines };
+            case VICGeometry::MainWindow :
+                return { model.firstColumnCycle * 8, 0x33, 320, 200 };
+            case VICGeometry::Full :
+            default:
+                return { 0, 0, uint32_t(kScreenWidth), uint32_t(kScreenHeight) };
+        }
+    }
+public:
+    VICII(Memory &memory, VICGeometry geometry = VICGeometry::Full);
+    // Render to an external buffer (e.g. from an arena), must be at least ExternalBufferSize() bytes - not owned.
+    // The three frame buffers are placed in it, presenting works the same as with the owned buffer
+    VICII(Memory &memory, void *ptrScreenBuffer, VICGeometry geometry = VICGeometry::Full);
+    ~VICII() override;
+    VICII(const VICII &) = delete;
+    VICII &operator=(const VICII &) = delete;
+
     void Tick();
-    const Pixmap &Screen() const { return screen; }
+    // Size of the frames and pixmaps, depends on the geometry
+    size_t ScreenWidth() const { return window.width; }
+    size_t ScreenHeight() const { return window.height; }
+    const VICWindow &ScreenWindow() const { return window; }
+
+    // Palette indices (0..15), ScreenWidth() x ScreenHeight() - the last completed frame, emulation thread only
+    const uint8_t *Frame() const { return completedFrame; }
+    // RGBA version of Frame(), converted on demand - headless runs never need to call this
+    const Pixmap &Screen();
+    // Presentation thread (e.g. UI), the latest completed frame - valid until the next call.
+    // Completed frames are handed over through a triple buffer, neither side ever waits for the other.
+    // Use either this or PresentedScreen(), both consume the same buffer
+    const uint8_t *AcquireFrame();
+    // RGBA version of AcquireFrame(), only the rows that differ from the previous presented frame are converted
+    const Pixmap &PresentedScreen();
+    // Rows changed by the last PresentedScreen() call, none when there was no new frame
+    const DirtyRows &PresentedDirtyRows() const { return presentedDirty; }
+
+    // Warp mode, raster timing, DMA and collisions are unaffected - only the pixels are skipped.
+    // 0 - never render, 1 - every frame (default), N - every Nth frame. The last rendered frame stays in Frame()
+    void SetRenderInterval(uint32_t nFrames);
+    // Render the next frame regardless of the interval, e.g. for a screenshot - done when FramesRendered() changes
+    void RequestFrame();
+    uint64_t FramesRendered() const { return nFramesRendered; }
+    // Bad lines and sprites steals cycles from the CPU through the bus, nullptr to disable
+    void ConnectBus(Bus *newBus) { bus = newBus; }
+    // Event driven instead of Tick(), the VIC only runs when it must and catches up lazily in between.
+    // The cycle at scheduler->Now() must not have been ticked, connect before the first cycle (or between Tick() calls)
+    void ConnectScheduler(Scheduler *newScheduler);
+    // Scheduled mode, runs the VIC up to the scheduler clock - register access does this implicitly.
+    // Call before looking at the raster position or the VIC state from the outside
+    void CatchUp();
+
+    // MemoryMappedIO, registers are mirrored every 64 bytes in $d000 - $d3ff
+    uint8_t ReadIO(uint16_t address) override;
+    void WriteIO(uint16_t address, uint8_t value) override;
 public:// Getters
     inline uint32_t RasterX() const { return rasterX; };
     inline uint32_t RasterY() const { return rasterY; }
+    inline bool IsCPUStunned() const { return (bus != nullptr) && bus->baLow; }
 private:
     template<typename T>
     inline T *GetReg(Regs reg) {
-        return reinterpret_cast<T *>(ram.PtrAt(reg));
+        return reinterpret_cast<T *>(&regs[reg & kRegMask]);
+    }
+    // Raster line 'y', must be within the window
+    inline uint8_t *FrameRow(uint32_t y) {
+        return &frame[WindowRow(y) * window.width];
+    }
+    // Frame row of raster line 'y', window.height or more when the line is outside the window
+    inline uint32_t WindowRow(uint32_t y) const {
+        return (y + model.nVerticalLines - window.y) % model.nVerticalLines;
+    }
+    inline uint8_t &Reg(Regs reg) {
+        return regs[reg & kRegMask];
+    }
+    inline uint8_t LineReg(Regs reg) const {
+        return lineRegs[reg & kRegMask];
+    }
+    inline uint8_t LineColor(Regs reg) const {
+        return lineRegs[reg & kRegMask] & 0x0f;
+    }
+    template<typename T>
+    inline const T *GetLineReg(Regs reg) const {
+        return reinterpret_cast<const T *>(&lineRegs[reg & kRegMask]);
     }
 
     bool IsInVerticalBorder();
     bool IsVBL();
+    // 25 rows (RSEL=1) displays lines $33 - $fa, 24 rows $37 - $f6
+    static constexpr bool IsInVerticalBorder(uint32_t y, bool rsel) {
+        return rsel ? ((y < 0x33) || (y > 0xfa)) : ((y < 0x37) || (y > 0xf6));
+    }
+    static constexpr bool IsVBL(uint32_t y) {
+        if constexpr (model.vblBegin > model.vblEnd) {
+            return (y >= model.vblBegin) || (y <= model.vblEnd);
+        } else {
+            return (y >= model.vblBegin) && (y <= model.vblEnd);
+        }
+    }
     bool IsBadLine();
+    void StartRasterLine();
+    void BeginRasterLine();
+    void HandleDMA();
     void HandleBadLine();
+    void UpdateRowCounter();
+    uint8_t VicRead(uint16_t address);
+    uint8_t FetchCharData(uint8_t ch);
+    uint16_t FetchBitmapAddress(uint32_t column);
+    uint8_t FetchBitmapData(uint32_t column);
+
+    // Graphics modes
+    using GraphicsRenderer = void (VICII::*)(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    static const GraphicsRenderer graphicsRenderers[8];
+    uint8_t GraphicsMode() const;
+    void RenderStandardText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderMultiColorText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderHiResBitmap(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderMultiColorBitmap(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderExtendedColorText(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderInvalid(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+    void RenderIdle(uint8_t *dst, uint32_t firstColumn, uint32_t nColumns);
+
+    // Sprites
+    // First s-access of sprite 'n' (0 based), the p-access is in the same cycle. Sprites 3-7 wrap in to the next line
+    static constexpr uint32_t SpriteFetchCycle(uint32_t n) { return (model.sprite0FetchCycle + n * 2) % kCyclesPerLine; }
+    void UpdateSpriteDMA();
+    void FetchSpriteData();
+    void RenderSprites(uint8_t *row);
     void UpdateHorizontalState();
     void UpdateVerticalState();
-    void RenderToScreen();
+    void RecordRegEvent(uint8_t idxReg, uint8_t value);
+    void WriteRasterCompare(uint16_t value);
+    void RaiseIRQ(uint8_t sources);
+    void UpdateIRQ();
+    void RenderLine(uint32_t endCycle);
+    void RenderSegment(uint8_t *row, uint32_t firstCycle, uint32_t lastCycle, bool verticalBorder);
+    void EndRasterLine();
+    void BeginFrame();
+    // Scheduled mode
+    static void OnLineEvent(void *context);
+    static void OnBAEvent(void *context);
+    static void OnBadLineDMAEvent(void *context);
+    void ScheduleBAEdge();
+    void ScheduleNextSync();
+    void SelectLineTarget();
+private:
+    static const uint16_t kRegMask = 0x3f;
+    static const uint8_t kNumRegs = 0x2f;
+    static constexpr uint32_t kCyclesPerLine = model.cyclesPerLine;
+    static const uint32_t kNumSprites = 8;
+    // Bit per pixel for a full line, with room for a 64 pixel window starting anywhere within the line
+    static const size_t kLineMaskWords = kScreenWidth / 64 + 2;
+    // Enough for one write per cycle, flushed early if the host writes more often
+    static const size_t kMaxRegEvents = 64;
+    // Interrupt sources in $d019/$d01a
+    static const uint8_t kIRQRaster = 0x01;
+    static const uint8_t kIRQSpriteBackground = 0x02;
+    static const uint8_t kIRQSpriteSprite = 0x04;
+    static const uint8_t kIRQLightPen = 0x08;
+    static const uint8_t kIRQSourceMask = 0x0f;
+
+    struct RegEvent {
+        uint8_t cycle;
+        uint8_t idxReg;
+        uint8_t value;
+    };
+    // see: http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt (section 3.8.1)
+    struct Sprite {
+        uint8_t mcBase;
+        uint8_t mc;
+        bool expandFF;      // Y expansion flip flop
+        uint32_t data;      // 24 bits, fetched at the end of the line before the one it is displayed on
+    };
 private:
     Memory &ram;
-    Pixmap screen;
+    VICWindow window;
+    bool cropLine;                  // the window is narrower than the line, lines are drawn in scratchLine and copied
+    uint32_t windowFirstCycle;      // cycles outside [windowFirstCycle, windowLastCycle) are not drawn
+    uint32_t windowLastCycle;
+    uint32_t frameEndLine;          // the line after the window, rendered frames are handed over when it starts
+    uint8_t *frame;                 // being drawn, frames[frameBuffers.Back()]
+    uint8_t *completedFrame;        // published last, still readable by the emulation thread until the next one
+    uint8_t *frames[kNumFrameBuffers];
+    bool ownsFrame;
+    TripleBuffer frameBuffers;
+    std::unique_ptr<Pixmap> screen;
+    // Row hashes per frame buffer (frame rows, not raster lines), written as the lines are completed
+    uint64_t rowHashes[kNumFrameBuffers][kScreenHeight];
+    // Owned by the presentation thread
+    std::unique_ptr<Pixmap> presented;
+    uint64_t presentedHashes[kScreenHeight];
+    DirtyRows presentedDirty;
+    uint64_t nFramesConverted;      // Screen() is up to date when this equals nFramesRendered
+    uint8_t *lineTarget;            // where the current line is drawn, nullptr - nothing to draw
+    bool lineVisible;               // lineTarget is in the frame
+    uint8_t scratchLine[kScreenWidth];
+private:
+    uint32_t renderInterval;
+    bool renderFrame;
+    bool frameRequested;
+    uint64_t nFrames;
+    uint64_t nFramesRendered;
+    uint8_t regs[kRegMask + 1];
+private:
+    // Register writes are recorded during the line and applied while rendering it at line end
+    uint8_t lineRegs[kRegMask + 1];     // registers as seen by the renderer
+    RegEvent regEvents[kMaxRegEvents];
+    size_t nRegEvents;
+    uint32_t lineRenderedCycle;         // cycles [0, lineRenderedCycle) of the current line are drawn
 private:
     uint32_t rasterY;
     uint32_t rasterX;
+    uint16_t rasterCompare;         // written through $d011 bit 7 / $d012, reads return the counter
     RasterYState rasterYState;
-    RasterXState rasterXState;
-    uint16_t videoMatrixAddress;
-    uint32_t videoMatrixCounter;
+    uint16_t bankAddress;           // No CIA2 yet, always bank 0
+    bool displayState;              // false - idle state
+    uint16_t videoMatrixBase;       // VCBASE
+    uint16_t videoMatrixCounter;    // VC, at the start of the line
 private:
-    bool cpuStunned;
-    uint8_t stunCycleCount;
+    Bus *bus;
+    Scheduler *scheduler;           // nullptr - Tick() every cycle
+    uint64_t lineStartCycle;        // scheduler cycle of rasterX = 0 in the line the VIC is at, may lag behind
+    Scheduler::EventId evLine;
+    Scheduler::EventId evBA;
+    Scheduler::EventId evBadLineDMA;
+    bool denLatched;        // DEN was set in raster line $30, required for bad lines
+    bool badLine;
+    bool lineHasDMA;
+    CycleMask baLowMask;    // Cycles within the current line where BA is low
     uint8_t chars[40];      // bad-line cache
+    uint8_t colors[40];     // colour ram, fetched together with chars
+    uint8_t columnForeground[40];               // foreground pixels of the last g-access per column
+    uint64_t lineForeground[kLineMaskWords];    // foreground pixels of the current line, LSB is the leftmost
 private:
-    uint32_t videoRowCounter;
+    Sprite sprites[kNumSprites];
+    uint8_t spriteDMA;          // one bit per sprite
+    uint8_t spriteFetched;      // sprites with data fetched for the next line
+private:
+    uint32_t videoRowCounter;   // RC
 private:
 
 };
 
+// Explicitly instantiated in vic.cpp
+extern template class VICII<VICModels::MOS6569>;
+extern template class VICII<VICModels::MOS6567R8>;
+extern template class VICII<VICModels::MOS6567R56A>;
+extern template class VICII<VICModels::MOS6572>;
+
+using VIC6569 = VICII<VICModels::MOS6569>;
+using VIC6567R8 = VICII<VICModels::MOS6567R8>;
+using VIC6567R56A = VICII<VICModels::MOS6567R56A>;
+using VIC6572 = VICII<VICModels::MOS6572>;
+// PAL is the default
+using VIC = VIC6569;
+
 
 #endif //EMU6502_VIC_H